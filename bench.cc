@@ -0,0 +1,428 @@
+#include "benchmark/benchmark.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "dArray.h"
+#include "dConcurrent.h"
+
+/*
+ * How to use:
+ *   ./bench                                    (all the benchmarks)
+ *   ./bench --benchmark_filter=QuickSort       (only some of them)
+ *   ./bench --benchmark_out=bench.json --benchmark_out_format=json
+ */
+
+#define MIN_SIZE 10
+#define MAX_SIZE 100000000
+#define MAX_QUADRATIC_SIZE 100000
+
+enum shape {
+  SHAPE_RANDOM,
+  SHAPE_SORTED,
+  SHAPE_REVERSE,
+  SHAPE_FEW_UNIQUE,
+  SHAPE_ORGAN_PIPE,
+  SHAPE_APPENDED,
+};
+
+static const char *shape_name(int shape) {
+  switch (shape) {
+    case SHAPE_RANDOM:     return "random";
+    case SHAPE_SORTED:     return "sorted";
+    case SHAPE_REVERSE:    return "reverse";
+    case SHAPE_FEW_UNIQUE: return "few_unique";
+    case SHAPE_ORGAN_PIPE: return "organ_pipe";
+    case SHAPE_APPENDED:   return "appended";
+  }
+  return "unknown";
+}
+
+static std::vector<int> make_input(std::size_t size, int shape) {
+  std::vector<int> input(size);
+  std::mt19937 gen(42);
+  for (std::size_t i = 0; i < size; ++i) {
+    switch (shape) {
+      case SHAPE_RANDOM:     input[i] = static_cast<int>(gen()); break;
+      case SHAPE_SORTED:     input[i] = static_cast<int>(i); break;
+      case SHAPE_REVERSE:    input[i] = static_cast<int>(size - i); break;
+      case SHAPE_FEW_UNIQUE: input[i] = static_cast<int>(gen() % 16); break;
+      case SHAPE_ORGAN_PIPE: input[i] = static_cast<int>(std::min(i, size - i)); break;
+      case SHAPE_APPENDED:   input[i] = (i < size - size / 10) ? static_cast<int>(i) : static_cast<int>(gen()); break;
+    }
+  }
+  return input;
+}
+
+/*
+ * Report the time per element and the capacity of the array and its scratch buffer in bytes
+ */
+static void report(benchmark::State& state, std::size_t elements, const struct array *a) {
+  state.SetItemsProcessed(state.iterations() * elements);
+  state.counters["time_per_element"] = benchmark::Counter(
+    static_cast<double>(state.iterations() * elements),
+    benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+  state.counters["capacity_bytes"] = static_cast<double>((a->capacity + a->scratch_capacity) * sizeof(int));
+}
+
+static void sizes(benchmark::internal::Benchmark *b, long max) {
+  for (long size = MIN_SIZE; size <= max; size *= 10) {
+    b->Arg(size);
+  }
+}
+
+static void sizes_and_arities(benchmark::internal::Benchmark *b) {
+  for (long size = MIN_SIZE; size <= MAX_SIZE; size *= 10) {
+    for (long arity : { 2, 4, 8 }) {
+      b->Args({ size, arity });
+    }
+  }
+}
+
+static void sizes_and_shapes(benchmark::internal::Benchmark *b) {
+  for (long size = MIN_SIZE; size <= MAX_SIZE; size *= 10) {
+    for (int shape = SHAPE_RANDOM; shape <= SHAPE_APPENDED; ++shape) {
+      b->Args({ size, shape });
+    }
+  }
+}
+
+/*
+ * Mutators
+ */
+
+static void BM_PushBack(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  struct array a;
+  array_create(&a);
+  for (auto _ : state) {
+    a.size = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+      array_push_back(&a, static_cast<int>(i));
+    }
+    benchmark::DoNotOptimize(a.data);
+  }
+  report(state, size, &a);
+  array_destroy(&a);
+}
+BENCHMARK(BM_PushBack)->Apply([](benchmark::internal::Benchmark *b) { sizes(b, MAX_SIZE); });
+
+static void BM_Insert(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  struct array a;
+  array_create(&a);
+  array_set_storage(&a, static_cast<enum array_storage>(state.range(1)));
+  for (auto _ : state) {
+    array_clear(&a);
+    for (std::size_t i = 0; i < size; ++i) {
+      array_insert(&a, static_cast<int>(i), i / 2);
+    }
+    benchmark::DoNotOptimize(a.data);
+  }
+  state.SetLabel(state.range(1) == ARRAY_STORAGE_GAP_BUFFER ? "gap_buffer" : "contiguous");
+  report(state, size, &a);
+  array_destroy(&a);
+}
+BENCHMARK(BM_Insert)->Apply([](benchmark::internal::Benchmark *b) {
+  for (long size = MIN_SIZE; size <= MAX_QUADRATIC_SIZE; size *= 10) {
+    b->Args({ size, ARRAY_STORAGE_CONTIGUOUS });
+    b->Args({ size, ARRAY_STORAGE_GAP_BUFFER });
+  }
+});
+
+/*
+ * Remove every other element, from the front
+ */
+static void BM_Purge(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  std::vector<int> input = make_input(size, SHAPE_RANDOM);
+  struct array a;
+  array_create(&a);
+  array_set_storage(&a, static_cast<enum array_storage>(state.range(1)));
+  for (auto _ : state) {
+    array_clear(&a);
+    array_append_range(&a, input.data(), size);
+    for (std::size_t i = 0; i < size / 2; ++i) {
+      array_remove(&a, i);
+    }
+    array_compact(&a);
+    benchmark::DoNotOptimize(a.data);
+  }
+  state.SetLabel(state.range(1) == ARRAY_STORAGE_TOMBSTONES ? "tombstones" : "contiguous");
+  report(state, size, &a);
+  array_destroy(&a);
+}
+BENCHMARK(BM_Purge)->Apply([](benchmark::internal::Benchmark *b) {
+  for (long size = MIN_SIZE; size <= MAX_QUADRATIC_SIZE; size *= 10) {
+    b->Args({ size, ARRAY_STORAGE_CONTIGUOUS });
+    b->Args({ size, ARRAY_STORAGE_TOMBSTONES });
+  }
+});
+
+/*
+ * Searches
+ */
+
+static void BM_SearchSorted(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  std::vector<int> input = make_input(size, SHAPE_SORTED);
+  std::vector<int> keys = make_input(1024, SHAPE_RANDOM);
+  for (int& key : keys) {
+    key = static_cast<int>(static_cast<unsigned>(key) % size);
+  }
+  struct array a;
+  array_create_from(&a, input.data(), size);
+  for (auto _ : state) {
+    for (int key : keys) {
+      benchmark::DoNotOptimize(array_search_sorted(&a, key));
+    }
+  }
+  report(state, keys.size(), &a);
+  array_destroy(&a);
+}
+BENCHMARK(BM_SearchSorted)->Apply([](benchmark::internal::Benchmark *b) { sizes(b, MAX_SIZE); });
+
+static void BM_SortedInsertBatch(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  const bool sorted_insert = state.range(1) != 0;
+  std::vector<int> input = make_input(size, SHAPE_SORTED);
+  std::vector<int> batch = make_input(64, SHAPE_RANDOM);
+  for (int& value : batch) {
+    value = static_cast<int>(static_cast<unsigned>(value) % size);
+  }
+  struct array a;
+  array_create(&a);
+  array_cache_sorted(&a, true);
+  for (auto _ : state) {
+    array_clear(&a);
+    array_append_range(&a, input.data(), size);
+    if (sorted_insert) {
+      array_sorted_insert_batch(&a, batch.data(), batch.size());
+    } else {
+      array_append_range(&a, batch.data(), batch.size());
+      array_quick_sort(&a);
+    }
+    benchmark::DoNotOptimize(array_is_sorted(&a));
+  }
+  state.SetLabel(sorted_insert ? "sorted_insert_batch" : "append + quick_sort");
+  report(state, size, &a);
+  array_destroy(&a);
+}
+BENCHMARK(BM_SortedInsertBatch)->Apply([](benchmark::internal::Benchmark *b) {
+  for (long size = MIN_SIZE; size <= MAX_SIZE; size *= 10) {
+    b->Args({ size, 0 });
+    b->Args({ size, 1 });
+  }
+});
+
+static void BM_Search(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  std::vector<int> input = make_input(size, SHAPE_SORTED);
+  struct array a;
+  array_create_from(&a, input.data(), size);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(array_search(&a, -1));
+  }
+  report(state, size, &a);
+  array_destroy(&a);
+}
+BENCHMARK(BM_Search)->Apply([](benchmark::internal::Benchmark *b) { sizes(b, MAX_SIZE); });
+
+static void BM_IsSorted(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  std::vector<int> input = make_input(size, SHAPE_SORTED);
+  struct array a;
+  array_create_from(&a, input.data(), size);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(array_is_sorted(&a));
+  }
+  report(state, size, &a);
+  array_destroy(&a);
+}
+BENCHMARK(BM_IsSorted)->Apply([](benchmark::internal::Benchmark *b) { sizes(b, MAX_SIZE); });
+
+/*
+ * Sorts, the copy of the input is part of the measure (it is linear and small compared to the sort)
+ */
+
+template<void (*Sort)(struct array *)>
+static void BM_Sort(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  std::vector<int> input = make_input(size, static_cast<int>(state.range(1)));
+  struct array a;
+  array_create_from(&a, input.data(), size);
+  for (auto _ : state) {
+    std::memcpy(a.data, input.data(), size * sizeof(int));
+    Sort(&a);
+    benchmark::DoNotOptimize(a.data);
+  }
+  state.SetLabel(shape_name(static_cast<int>(state.range(1))));
+  report(state, size, &a);
+  array_destroy(&a);
+}
+
+static void parallel_sort(struct array *self) {
+  array_parallel_sort(self, 0);
+}
+
+BENCHMARK_TEMPLATE(BM_Sort, array_quick_sort)->Apply(sizes_and_shapes);
+BENCHMARK_TEMPLATE(BM_Sort, array_pdq_sort)->Apply(sizes_and_shapes);
+BENCHMARK_TEMPLATE(BM_Sort, array_heap_sort)->Apply(sizes_and_shapes);
+BENCHMARK_TEMPLATE(BM_Sort, array_stable_sort)->Apply(sizes_and_shapes);
+BENCHMARK_TEMPLATE(BM_Sort, array_radix_sort)->Apply(sizes_and_shapes);
+BENCHMARK_TEMPLATE(BM_Sort, parallel_sort)->Apply(sizes_and_shapes);
+
+/*
+ * Selection on random input: the 99th percentile and the 100 largest values
+ */
+
+static void BM_NthElement(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  std::vector<int> input = make_input(size, SHAPE_RANDOM);
+  struct array a;
+  array_create_from(&a, input.data(), size);
+  for (auto _ : state) {
+    std::memcpy(a.data, input.data(), size * sizeof(int));
+    array_nth_element(&a, size * 99 / 100);
+    benchmark::DoNotOptimize(a.data);
+  }
+  report(state, size, &a);
+  array_destroy(&a);
+}
+BENCHMARK(BM_NthElement)->Apply([](benchmark::internal::Benchmark *b) { sizes(b, MAX_SIZE); });
+
+static void BM_TopK(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  std::vector<int> input = make_input(size, SHAPE_RANDOM);
+  struct array a, out;
+  array_create_from(&a, input.data(), size);
+  array_create(&out);
+  for (auto _ : state) {
+    array_top_k(&a, 100, &out);
+    benchmark::DoNotOptimize(out.data);
+  }
+  report(state, size, &a);
+  array_destroy(&a);
+  array_destroy(&out);
+}
+BENCHMARK(BM_TopK)->Apply([](benchmark::internal::Benchmark *b) { sizes(b, MAX_SIZE); });
+
+/*
+ * Set operations on sorted inputs, the second one is range(1) times smaller (1 merges, 1000 gallops)
+ */
+
+template<bool (*Operation)(const struct array *, const struct array *, struct array *)>
+static void BM_SetOperation(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  const std::size_t other_size = size / state.range(1);
+  struct array a, b, out;
+  array_create(&a);
+  array_create(&b);
+  array_create(&out);
+  for (std::size_t i = 0; i < size; ++i) {
+    array_push_back(&a, static_cast<int>(2 * i));
+  }
+  for (std::size_t i = 0; i < other_size; ++i) {
+    array_push_back(&b, static_cast<int>(3 * i * state.range(1)));
+  }
+  for (auto _ : state) {
+    Operation(&a, &b, &out);
+    benchmark::DoNotOptimize(out.data);
+  }
+  report(state, size + other_size, &out);
+  array_destroy(&a);
+  array_destroy(&b);
+  array_destroy(&out);
+}
+
+static void sizes_and_ratios(benchmark::internal::Benchmark *b) {
+  for (long size = MIN_SIZE; size <= MAX_SIZE; size *= 10) {
+    for (long ratio : { 1, 1000 }) {
+      b->Args({ size, ratio });
+    }
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_SetOperation, array_merge)->Apply(sizes_and_ratios);
+BENCHMARK_TEMPLATE(BM_SetOperation, array_set_union)->Apply(sizes_and_ratios);
+BENCHMARK_TEMPLATE(BM_SetOperation, array_set_intersection)->Apply(sizes_and_ratios);
+BENCHMARK_TEMPLATE(BM_SetOperation, array_set_difference)->Apply(sizes_and_ratios);
+
+/*
+ * Appends from several threads: the concurrent array against a plain array behind a mutex
+ */
+
+static struct array_concurrent concurrent_array;
+static struct array locked_array;
+static std::mutex locked_array_mutex;
+
+static void BM_ConcurrentPushBack(benchmark::State& state) {
+  if (state.thread_index() == 0) array_concurrent_create(&concurrent_array);
+  for (auto _ : state) {
+    array_concurrent_push_back(&concurrent_array, 1);
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) array_concurrent_destroy(&concurrent_array);
+}
+BENCHMARK(BM_ConcurrentPushBack)->ThreadRange(1, 8)->UseRealTime();
+
+static void BM_LockedPushBack(benchmark::State& state) {
+  if (state.thread_index() == 0) array_create(&locked_array);
+  for (auto _ : state) {
+    std::lock_guard<std::mutex> lock(locked_array_mutex);
+    array_push_back(&locked_array, 1);
+  }
+  state.SetItemsProcessed(state.iterations());
+  if (state.thread_index() == 0) array_destroy(&locked_array);
+}
+BENCHMARK(BM_LockedPushBack)->ThreadRange(1, 8)->UseRealTime();
+
+/*
+ * Heap
+ */
+
+static void BM_HeapAdd(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  std::vector<int> input = make_input(size, SHAPE_RANDOM);
+  struct array a;
+  array_create(&a);
+  array_set_heap_arity(&a, static_cast<unsigned>(state.range(1)));
+  for (auto _ : state) {
+    a.size = 0;
+    for (int value : input) {
+      array_heap_add(&a, value);
+    }
+    benchmark::DoNotOptimize(a.data);
+  }
+  report(state, size, &a);
+  array_destroy(&a);
+}
+BENCHMARK(BM_HeapAdd)->Apply(sizes_and_arities);
+
+static void BM_HeapRemoveTop(benchmark::State& state) {
+  const std::size_t size = state.range(0);
+  std::vector<int> input = make_input(size, SHAPE_RANDOM);
+  struct array a;
+  array_create(&a);
+  array_set_heap_arity(&a, static_cast<unsigned>(state.range(1)));
+  for (int value : input) {
+    array_heap_add(&a, value);
+  }
+  std::vector<int> heap(a.data, a.data + a.size);
+  for (auto _ : state) {
+    std::memcpy(a.data, heap.data(), size * sizeof(int));
+    a.size = size;
+    while (!array_empty(&a)) {
+      array_heap_remove_top(&a);
+    }
+  }
+  report(state, size, &a);
+  array_destroy(&a);
+}
+BENCHMARK(BM_HeapRemoveTop)->Apply(sizes_and_arities);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,210 @@
+#include "dAllocator.h"
+
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_ALIGNMENT alignof(max_align_t)
+
+static size_t array_align(size_t bytes) {
+  return (bytes + ARRAY_ALIGNMENT - 1) & ~(ARRAY_ALIGNMENT - 1);
+}
+
+/*
+ * Arena
+ */
+
+#define ARRAY_ARENA_BLOCK_SIZE (1 << 20)
+
+struct array_arena_block {
+  struct array_arena_block *next;
+  size_t size;
+  alignas(max_align_t) char memory[];
+};
+
+/*
+ * Move to the next block with enough room, or add a new one after the current block
+ */
+static bool array_arena_next_block(struct array_arena *self, size_t bytes) {
+  struct array_arena_block *block = (self->current != NULL) ? self->current->next : self->first;
+  while (block != NULL && block->size < bytes) {
+    block = block->next;
+  }
+  if (block == NULL) {
+    size_t size = (bytes > self->block_size) ? bytes : self->block_size;
+    block = malloc(sizeof(struct array_arena_block) + size);
+    if (block == NULL) return false;
+    block->size = size;
+    if (self->current != NULL) {
+      block->next = self->current->next;
+      self->current->next = block;
+    } else {
+      block->next = self->first;
+      self->first = block;
+    }
+  }
+  self->current = block;
+  self->cursor = block->memory;
+  self->end = block->memory + block->size;
+  return true;
+}
+
+static void *array_arena_alloc(void *context, size_t bytes) {
+  struct array_arena *self = context;
+  bytes = array_align(bytes);
+  if ((size_t)(self->end - self->cursor) < bytes && !array_arena_next_block(self, bytes)) return NULL;
+  void *ptr = self->cursor;
+  self->cursor += bytes;
+  return ptr;
+}
+
+static void *array_arena_realloc(void *context, void *ptr, size_t old_bytes, size_t new_bytes) {
+  struct array_arena *self = context;
+  old_bytes = array_align(old_bytes);
+  // the last allocation can grow or shrink in place
+  if ((char *)ptr + old_bytes == self->cursor && (size_t)(self->end - (char *)ptr) >= array_align(new_bytes)) {
+    self->cursor = (char *)ptr + array_align(new_bytes);
+    return ptr;
+  }
+  void *copy = array_arena_alloc(context, new_bytes);
+  if (copy == NULL) return NULL;
+  memcpy(copy, ptr, (old_bytes < new_bytes) ? old_bytes : new_bytes);
+  return copy;
+}
+
+static void array_arena_free(void *context, void *ptr, size_t bytes) {
+  struct array_arena *self = context;
+  if ((char *)ptr + array_align(bytes) == self->cursor) {
+    self->cursor = ptr;
+  }
+}
+
+void array_arena_create(struct array_arena *self, size_t block_size) {
+  self->allocator.alloc = array_arena_alloc;
+  self->allocator.realloc = array_arena_realloc;
+  self->allocator.free = array_arena_free;
+  self->allocator.context = self;
+  self->first = NULL;
+  self->current = NULL;
+  self->cursor = NULL;
+  self->end = NULL;
+  self->block_size = (block_size > 0) ? array_align(block_size) : ARRAY_ARENA_BLOCK_SIZE;
+}
+
+void array_arena_reset(struct array_arena *self) {
+  self->current = self->first;
+  if (self->first != NULL) {
+    self->cursor = self->first->memory;
+    self->end = self->first->memory + self->first->size;
+  }
+}
+
+void array_arena_destroy(struct array_arena *self) {
+  struct array_arena_block *block = self->first;
+  while (block != NULL) {
+    struct array_arena_block *next = block->next;
+    free(block);
+    block = next;
+  }
+  self->first = NULL;
+  self->current = NULL;
+  self->cursor = NULL;
+  self->end = NULL;
+}
+
+/*
+ * Pool
+ */
+
+#define ARRAY_POOL_MIN_SHIFT 4
+#define ARRAY_POOL_MAX_SIZE ((size_t)1 << (ARRAY_POOL_MIN_SHIFT + ARRAY_POOL_CLASSES - 1))
+#define ARRAY_POOL_SLAB_SIZE (ARRAY_POOL_MAX_SIZE * 4)
+
+struct array_pool_slab {
+  struct array_pool_slab *next;
+  alignas(max_align_t) char memory[ARRAY_POOL_SLAB_SIZE];
+};
+
+/*
+ * Index of the smallest class that holds bytes, or ARRAY_POOL_CLASSES if it is too big
+ */
+static unsigned array_pool_class(size_t bytes) {
+  if (bytes > ARRAY_POOL_MAX_SIZE) return ARRAY_POOL_CLASSES;
+  if (bytes <= ((size_t)1 << ARRAY_POOL_MIN_SHIFT)) return 0;
+  unsigned bits = (unsigned)(sizeof(unsigned long long) * 8) - (unsigned)__builtin_clzll((unsigned long long)(bytes - 1));
+  return bits - ARRAY_POOL_MIN_SHIFT;
+}
+
+static void *array_pool_alloc(void *context, size_t bytes) {
+  struct array_pool *self = context;
+  unsigned index = array_pool_class(bytes);
+  if (index == ARRAY_POOL_CLASSES) return malloc(bytes);
+
+  void *ptr = self->free_lists[index];
+  if (ptr != NULL) {
+    memcpy(&self->free_lists[index], ptr, sizeof(void *));
+    return ptr;
+  }
+
+  size_t size = (size_t)1 << (index + ARRAY_POOL_MIN_SHIFT);
+  if ((size_t)(self->end - self->cursor) < size) {
+    struct array_pool_slab *slab = malloc(sizeof(struct array_pool_slab));
+    if (slab == NULL) return NULL;
+    slab->next = self->slabs;
+    self->slabs = slab;
+    self->cursor = slab->memory;
+    self->end = slab->memory + ARRAY_POOL_SLAB_SIZE;
+  }
+  ptr = self->cursor;
+  self->cursor += size;
+  return ptr;
+}
+
+static void array_pool_free(void *context, void *ptr, size_t bytes) {
+  struct array_pool *self = context;
+  unsigned index = array_pool_class(bytes);
+  if (index == ARRAY_POOL_CLASSES) {
+    free(ptr);
+    return;
+  }
+  memcpy(ptr, &self->free_lists[index], sizeof(void *));
+  self->free_lists[index] = ptr;
+}
+
+static void *array_pool_realloc(void *context, void *ptr, size_t old_bytes, size_t new_bytes) {
+  unsigned old_index = array_pool_class(old_bytes);
+  unsigned new_index = array_pool_class(new_bytes);
+  if (old_index == new_index) {
+    if (old_index < ARRAY_POOL_CLASSES) return ptr;
+    return realloc(ptr, new_bytes);
+  }
+  void *copy = array_pool_alloc(context, new_bytes);
+  if (copy == NULL) return NULL;
+  memcpy(copy, ptr, (old_bytes < new_bytes) ? old_bytes : new_bytes);
+  array_pool_free(context, ptr, old_bytes);
+  return copy;
+}
+
+void array_pool_create(struct array_pool *self) {
+  self->allocator.alloc = array_pool_alloc;
+  self->allocator.realloc = array_pool_realloc;
+  self->allocator.free = array_pool_free;
+  self->allocator.context = self;
+  for (unsigned i = 0; i < ARRAY_POOL_CLASSES; ++i) {
+    self->free_lists[i] = NULL;
+  }
+  self->slabs = NULL;
+  self->cursor = NULL;
+  self->end = NULL;
+}
+
+void array_pool_destroy(struct array_pool *self) {
+  struct array_pool_slab *slab = self->slabs;
+  while (slab != NULL) {
+    struct array_pool_slab *next = slab->next;
+    free(slab);
+    slab = next;
+  }
+  array_pool_create(self);
+}
@@ -0,0 +1,73 @@
+#ifndef ALLOCATORS_H
+#define ALLOCATORS_H
+
+#include <stddef.h>
+
+#include "dArray.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bump-pointer arena: allocations are carved one after the other in big blocks,
+ * free does nothing (except for the last allocation) and everything is released
+ * at once by array_arena_reset. Not thread-safe.
+ */
+struct array_arena_block;
+
+struct array_arena {
+  struct array_allocator allocator; // to give to array_create_with_allocator
+  struct array_arena_block *first;
+  struct array_arena_block *current;
+  char *cursor;
+  char *end;
+  size_t block_size;
+};
+
+/*
+ * Create an arena that gets its memory in blocks of block_size bytes (0 for the default size)
+ */
+void array_arena_create(struct array_arena *self, size_t block_size);
+
+/*
+ * Release all the allocations at once, the blocks are kept for the next allocations
+ */
+void array_arena_reset(struct array_arena *self);
+
+/*
+ * Destroy the arena and give its blocks back to the system
+ */
+void array_arena_destroy(struct array_arena *self);
+
+/*
+ * Size-class pool: allocations are rounded up to a power of two and recycled through
+ * one free list per class, large allocations go to malloc. Not thread-safe.
+ */
+#define ARRAY_POOL_CLASSES 13 // 16 bytes to 64 KiB
+
+struct array_pool_slab;
+
+struct array_pool {
+  struct array_allocator allocator; // to give to array_create_with_allocator
+  void *free_lists[ARRAY_POOL_CLASSES];
+  struct array_pool_slab *slabs;
+  char *cursor;
+  char *end;
+};
+
+/*
+ * Create an empty pool
+ */
+void array_pool_create(struct array_pool *self);
+
+/*
+ * Destroy the pool and give its slabs back to the system (the arrays using it must be destroyed before)
+ */
+void array_pool_destroy(struct array_pool *self);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ALLOCATORS_H
@@ -1,38 +1,691 @@
+#define _GNU_SOURCE // mremap
+
 #include "dArray.h"
 
+// the generic kernels count their comparisons and swaps in the statistics
+#define ARRAY_KERNEL_COMPARE(n) ARRAY_STATS_COMPARE(n)
+#define ARRAY_KERNEL_SWAP() ARRAY_STATS_SWAP()
+#include "dArrayGeneric.h"
+
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ARRAY_X86 1
+#include <immintrin.h>
+#else
+#define ARRAY_X86 0
+#endif
+
+/*
+ * With tombstones, the dead slots are squeezed out once they are more than one slot in this many
+ */
+#define ARRAY_COMPACT_THRESHOLD 4
+
+/*
+ * Memory of the buffers, from the allocator of the array or from the C library by default
+ */
+
+static void *array_allocate(const struct array *self, size_t bytes) {
+  if (self->allocator == NULL) return malloc(bytes);
+  return self->allocator->alloc(self->allocator->context, bytes);
+}
+
+static void *array_reallocate(const struct array *self, void *ptr, size_t old_bytes, size_t new_bytes) {
+  if (self->allocator == NULL) return realloc(ptr, new_bytes);
+  if (ptr == NULL) return self->allocator->alloc(self->allocator->context, new_bytes);
+  return self->allocator->realloc(self->allocator->context, ptr, old_bytes, new_bytes);
+}
+
+static void array_deallocate(const struct array *self, void *ptr, size_t bytes) {
+  if (ptr == NULL) return;
+  if (self->allocator == NULL) {
+    free(ptr);
+    return;
+  }
+  self->allocator->free(self->allocator->context, ptr, bytes);
+}
+
+static bool array_is_inline(const struct array *self) {
+  return self->data == self->inline_data;
+}
+
+/*
+ * Statistics: the comparisons and swaps are counted per thread, and the public functions that make
+ * them open a scope that adds what was counted to the array and to the global counters when the
+ * outermost one ends (the sorts and searches are also timed). Without DARRAY_STATS the macros are empty
+ */
+
+#ifdef DARRAY_STATS
+
+enum array_stats_kind {
+  ARRAY_STATS_COUNT,
+  ARRAY_STATS_SORT,
+  ARRAY_STATS_SEARCH,
+};
+
+struct array_stats_scope {
+  struct array *self;
+  enum array_stats_kind kind;
+  const char *function;
+  bool outermost;
+  uint64_t start_ns;
+  uint64_t comparisons;
+  uint64_t swaps;
+};
+
+static const struct {
+  const char *name;
+  size_t offset;
+  bool peak; // keeps the largest value instead of a sum
+} array_stats_fields[] = {
+  { "reallocs", offsetof(struct array_stats, reallocs), false },
+  { "bytes_copied", offsetof(struct array_stats, bytes_copied), false },
+  { "comparisons", offsetof(struct array_stats, comparisons), false },
+  { "swaps", offsetof(struct array_stats, swaps), false },
+  { "peak_capacity", offsetof(struct array_stats, peak_capacity), true },
+  { "peak_size", offsetof(struct array_stats, peak_size), true },
+  { "sorts", offsetof(struct array_stats, sorts), false },
+  { "sort_ns", offsetof(struct array_stats, sort_ns), false },
+  { "searches", offsetof(struct array_stats, searches), false },
+  { "search_ns", offsetof(struct array_stats, search_ns), false },
+};
+
+#define ARRAY_STATS_FIELDS (sizeof(array_stats_fields) / sizeof(array_stats_fields[0]))
+
+static struct array_stats array_global_stats;
+static _Thread_local uint64_t array_thread_comparisons;
+static _Thread_local uint64_t array_thread_swaps;
+static _Thread_local unsigned array_stats_depth;
+static void (*array_stats_hook)(void *context, const char *function, size_t size, uint64_t nanoseconds);
+static void *array_stats_hook_context;
+
+static uint64_t *array_stats_field(const struct array_stats *stats, size_t i) {
+  return (uint64_t *)((char *)stats + array_stats_fields[i].offset);
+}
+
+/*
+ * Add delta to stats, other threads may update them at the same time (the global ones, or an array
+ * searched by several threads)
+ */
+static void array_stats_add(struct array_stats *stats, const struct array_stats *delta) {
+  for (size_t i = 0; i < ARRAY_STATS_FIELDS; ++i) {
+    uint64_t value = *array_stats_field(delta, i);
+    uint64_t *counter = array_stats_field(stats, i);
+    if (!array_stats_fields[i].peak) {
+      if (value != 0) __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+      continue;
+    }
+    uint64_t current = __atomic_load_n(counter, __ATOMIC_RELAXED);
+    while (value > current && !__atomic_compare_exchange_n(counter, &current, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+  }
+}
+
+static void array_stats_record(const struct array *self, const struct array_stats *delta) {
+  array_stats_add(&((struct array *)self)->stats, delta);
+  array_stats_add(&array_global_stats, delta);
+}
+
+static uint64_t array_stats_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+static struct array_stats_scope array_stats_begin(const struct array *self, enum array_stats_kind kind, const char *function) {
+  struct array_stats_scope scope = {
+    .self = (struct array *)self,
+    .kind = kind,
+    .function = function,
+    .outermost = array_stats_depth++ == 0,
+    .comparisons = array_thread_comparisons,
+    .swaps = array_thread_swaps,
+  };
+  if (scope.outermost && kind != ARRAY_STATS_COUNT) scope.start_ns = array_stats_now();
+  return scope;
+}
+
+static void array_stats_end(struct array_stats_scope *scope) {
+  --array_stats_depth;
+  if (!scope->outermost) return;
+  struct array_stats delta = {
+    .comparisons = array_thread_comparisons - scope->comparisons,
+    .swaps = array_thread_swaps - scope->swaps,
+  };
+  if (scope->kind != ARRAY_STATS_COUNT) {
+    uint64_t ns = array_stats_now() - scope->start_ns;
+    if (scope->kind == ARRAY_STATS_SORT) {
+      delta.sorts = 1;
+      delta.sort_ns = ns;
+    } else {
+      delta.searches = 1;
+      delta.search_ns = ns;
+    }
+    if (array_stats_hook != NULL) array_stats_hook(array_stats_hook_context, scope->function, scope->self->size, ns);
+  }
+  array_stats_record(scope->self, &delta);
+}
+
+static void array_stats_resize(struct array *self, size_t copied, size_t capacity) {
+  array_stats_record(self, &(struct array_stats){ .reallocs = 1, .bytes_copied = copied * sizeof(int), .peak_capacity = capacity });
+}
+
+static void array_stats_size(struct array *self, size_t size) {
+  if (size > self->stats.peak_size) array_stats_record(self, &(struct array_stats){ .peak_size = size });
+}
+
+int array_stats_dump(char *buf, size_t size, const struct array_stats *stats, enum array_stats_format format) {
+  bool json = format == ARRAY_STATS_JSON;
+  size_t length = 0;
+  for (size_t i = 0; i <= ARRAY_STATS_FIELDS; ++i) {
+    char *at = (length < size) ? buf + length : NULL;
+    size_t room = (length < size) ? size - length : 0;
+    int n;
+    if (i == ARRAY_STATS_FIELDS) {
+      n = json ? snprintf(at, room, "}\n") : 0;
+    } else if (json) {
+      n = snprintf(at, room, "%s\"%s\": %" PRIu64, (i == 0) ? "{" : ", ", array_stats_fields[i].name, *array_stats_field(stats, i));
+    } else {
+      n = snprintf(at, room, "%-14s %" PRIu64 "\n", array_stats_fields[i].name, *array_stats_field(stats, i));
+    }
+    if (n < 0) return n;
+    length += (size_t)n;
+  }
+  return (int)length;
+}
+
+void array_stats_global(struct array_stats *stats) {
+  for (size_t i = 0; i < ARRAY_STATS_FIELDS; ++i) {
+    *array_stats_field(stats, i) = __atomic_load_n(array_stats_field(&array_global_stats, i), __ATOMIC_RELAXED);
+  }
+}
+
+void array_stats_reset(struct array *self) {
+  memset(&self->stats, 0, sizeof(self->stats));
+}
+
+void array_stats_reset_global(void) {
+  for (size_t i = 0; i < ARRAY_STATS_FIELDS; ++i) {
+    __atomic_store_n(array_stats_field(&array_global_stats, i), 0, __ATOMIC_RELAXED);
+  }
+}
+
+void array_stats_set_hook(void (*hook)(void *context, const char *function, size_t size, uint64_t nanoseconds), void *context) {
+  array_stats_hook = hook;
+  array_stats_hook_context = context;
+}
+
+#define ARRAY_STATS_SCOPE(self, kind) \
+  struct array_stats_scope array_stats_scope __attribute__((cleanup(array_stats_end))) = array_stats_begin((self), (kind), __func__)
+#define ARRAY_STATS_COMPARE(n) (array_thread_comparisons += (n))
+#define ARRAY_STATS_SWAP() (++array_thread_swaps)
+// hand the counts of a helper thread to the scope of the thread that waits for it
+#define ARRAY_STATS_EXPORT(comparisons, swaps) ((comparisons) = array_thread_comparisons, (swaps) = array_thread_swaps)
+#define ARRAY_STATS_IMPORT(comparisons, swaps) (array_thread_comparisons += (comparisons), array_thread_swaps += (swaps))
+#define ARRAY_STATS_RESIZE(self, copied, capacity) array_stats_resize((self), (copied), (capacity))
+#define ARRAY_STATS_SIZE(self, size) array_stats_size((self), (size))
+
+#else
+
+#define ARRAY_STATS_SCOPE(self, kind) ((void)0)
+#define ARRAY_STATS_COMPARE(n) ((void)0)
+#define ARRAY_STATS_SWAP() ((void)0)
+#define ARRAY_STATS_EXPORT(comparisons, swaps) ((void)0)
+#define ARRAY_STATS_IMPORT(comparisons, swaps) ((void)0)
+#define ARRAY_STATS_RESIZE(self, copied, capacity) ((void)0)
+#define ARRAY_STATS_SIZE(self, size) ((void)0)
+
+#endif
+
+/*
+ * The searches, sorts and heap functions on the elements are the int instantiation of the generic kernels
+ */
+ARRAY_DEFINE_KERNELS(int, array, ARRAY_LESS)
+
+/*
+ * Tombstones: the bitmap of the dead slots (one word per 64 slots of the capacity) is followed
+ * by a Fenwick tree of the number of dead slots per word, so that the slot of the element
+ * at an index is found in O(log n)
+ */
+
+static size_t array_tombstone_words(const struct array *self) {
+  return (self->capacity + 63) / 64;
+}
+
+static size_t array_tombstone_bytes(const struct array *self) {
+  return (2 * array_tombstone_words(self) + 1) * sizeof(uint64_t);
+}
+
+static size_t array_tombstone_select(const struct array *self, size_t index) {
+  size_t words = array_tombstone_words(self);
+  const uint64_t *tree = self->tombstones + words;
+  size_t word = 0;
+  size_t step = 1;
+  while (step * 2 <= words) step *= 2;
+  for (; step > 0; step /= 2) {
+    if (word + step > words) continue;
+    size_t live = step * 64 - (size_t)tree[word + step];
+    if (live <= index) {
+      word += step;
+      index -= live;
+    }
+  }
+  uint64_t live = ~self->tombstones[word];
+  for (; index > 0; --index) live &= live - 1;
+  return word * 64 + (size_t)__builtin_ctzll(live);
+}
+
+static void array_tombstone_mark(struct array *self, size_t slot) {
+  size_t words = array_tombstone_words(self);
+  uint64_t *tree = self->tombstones + words;
+  self->tombstones[slot / 64] |= UINT64_C(1) << (slot % 64);
+  for (size_t k = slot / 64 + 1; k <= words; k += k & (~k + 1)) ++tree[k];
+}
+
+/*
+ * Squeeze out the dead slots in one pass, the words without a dead slot are moved as a block
+ */
+static void array_compact_tombstones(struct array *self) {
+  size_t used = self->size + self->dead;
+  size_t out = 0;
+  for (size_t base = 0; base < used; base += 64) {
+    size_t n = (used - base < 64) ? used - base : 64;
+    uint64_t dead = self->tombstones[base / 64];
+    if (dead == 0) {
+      memmove(self->data + out, self->data + base, n * sizeof(int));
+      out += n;
+      continue;
+    }
+    uint64_t live = ~dead & ((n == 64) ? ~UINT64_C(0) : (UINT64_C(1) << n) - 1);
+    while (live != 0) {
+      self->data[out++] = self->data[base + (size_t)__builtin_ctzll(live)];
+      live &= live - 1;
+    }
+  }
+  array_deallocate(self, self->tombstones, array_tombstone_bytes(self));
+  self->tombstones = NULL;
+  self->dead = 0;
+}
+
+/*
+ * Move the elements that follow the gap down to it, the free slots all go back to the end
+ */
+static void array_close_gap(struct array *self) {
+  memmove(self->data + self->gap, self->data + self->gap + self->gap_size, (self->size - self->gap) * sizeof(int));
+  self->gap = self->size;
+  self->gap_size = 0;
+}
+
+/*
+ * Make the elements contiguous (close the gap, squeeze out the tombstones) before working on the
+ * buffer directly. The functions that take a const array read around them instead
+ */
+static inline int *array_contiguous(struct array *self) {
+  if (self->gap_size != 0) array_close_gap(self);
+  if (self->dead != 0) array_compact_tombstones(self);
+  return self->data;
+}
+
+static inline bool array_is_contiguous(const struct array *self) {
+  return self->gap_size == 0 && self->dead == 0;
+}
+
+/*
+ * Number of slots from the start of the buffer to the last element
+ */
+static inline size_t array_used(const struct array *self) {
+  return self->size + self->gap_size + self->dead;
+}
+
+/*
+ * First slot from slot on that is dead (or live), the end of the bitmap if there is none
+ */
+static size_t array_tombstone_next(const struct array *self, size_t slot, bool dead) {
+  size_t words = array_tombstone_words(self);
+  size_t word = slot / 64;
+  if (word >= words) return slot;
+  uint64_t bits = (dead ? self->tombstones[word] : ~self->tombstones[word]) & (~UINT64_C(0) << (slot % 64));
+  while (bits == 0) {
+    if (++word == words) return words * 64;
+    bits = dead ? self->tombstones[word] : ~self->tombstones[word];
+  }
+  return word * 64 + (size_t)__builtin_ctzll(bits);
+}
+
+/*
+ * Move slot to the start of the next run of elements stored next to each other and return its length,
+ * 0 past the last element. The runs are the elements in order, without touching the gap or the dead slots:
+ *
+ *   for (size_t slot = 0, n; (n = array_run(self, &slot)) != 0; slot += n) ...
+ */
+static size_t array_run(const struct array *self, size_t *slot) {
+  size_t used = array_used(self);
+  size_t first = *slot;
+  size_t last = used;
+  if (self->dead != 0) {
+    first = array_tombstone_next(self, first, false);
+    if (first < used) last = array_tombstone_next(self, first, true);
+  } else if (self->gap_size != 0) {
+    if (first >= self->gap && first < self->gap + self->gap_size) first = self->gap + self->gap_size;
+    if (first < self->gap) last = self->gap;
+  }
+  if (first >= used) return 0;
+  *slot = first;
+  return ((last < used) ? last : used) - first;
+}
+
+/*
+ * Get the elements in order without changing the array: the buffer itself when they are contiguous,
+ * otherwise a copy gathered from the runs, to be given back to array_release_view
+ */
+static bool array_view(const struct array *self, const int **view) {
+  *view = self->data;
+  if (array_is_contiguous(self) || self->size == 0) return true;
+  int *copy = malloc(self->size * sizeof(int));
+  if (copy == NULL) return false;
+  size_t k = 0;
+  for (size_t slot = 0, n; (n = array_run(self, &slot)) != 0; slot += n) {
+    memcpy(copy + k, self->data + slot, n * sizeof(int));
+    k += n;
+  }
+  *view = copy;
+  return true;
+}
+
+static void array_release_view(const struct array *self, const int *view) {
+  if (view != self->data) free((int *)view);
+}
 
 void print_array(struct array *self){
+  array_contiguous(self);
   for(size_t i =0; i<self->size; ++i){
     printf("[%d]", self->data[i]);
   }
   printf("\n");
 }
 
-void array_create(struct array *self) {
-  self-> capacity = 10;
+/*
+ * Initialize an empty array, returns false if the buffer for capacity elements cannot be allocated
+ * (the array then starts with its inline buffer)
+ */
+static bool array_init(struct array *self, size_t capacity, const struct array_allocator *allocator) {
+  self-> allocator = allocator;
   self-> size = 0;
-  self-> data = calloc(self-> capacity, sizeof(int));
+  self-> capacity = ARRAY_INLINE_CAPACITY;
+  self-> data = self-> inline_data;
+  bool allocated = true;
+  if (capacity > ARRAY_INLINE_CAPACITY) {
+    int *data = (capacity > SIZE_MAX / sizeof(int)) ? NULL : array_allocate(self, capacity * sizeof(int));
+    allocated = data != NULL;
+    if (allocated) {
+      self-> capacity = capacity;
+      self-> data = data;
+    }
+  }
+  self-> growth = ARRAY_GROWTH_DOUBLE;
+  self-> growth_chunk = 0;
+  self-> scratch = NULL;
+  self-> scratch_capacity = 0;
+  self-> heap_arity = 2;
+  self-> storage = ARRAY_STORAGE_CONTIGUOUS;
+  self-> gap = 0;
+  self-> gap_size = 0;
+  self-> dead = 0;
+  self-> tombstones = NULL;
+  self-> sorted = false;
+  self-> sorted_cache = false;
+#ifdef DARRAY_STATS
+  memset(&self->stats, 0, sizeof(self->stats));
+  array_stats_record(self, &(struct array_stats){ .peak_capacity = self->capacity });
+#endif
+  return allocated;
+}
+
+void array_create(struct array *self) {
+  array_init(self, 0, NULL);
+}
+
+void array_create_with_allocator(struct array *self, const struct array_allocator *allocator) {
+  array_init(self, 0, allocator);
+}
+
+bool array_create_with_capacity(struct array *self, size_t capacity) {
+  return array_init(self, capacity, NULL);
+}
+
+void array_create_adopt(struct array *self, int *buf, size_t size, size_t cap) {
+  array_init(self, 0, NULL);
+  self-> data = buf;
+  self-> capacity = cap;
+  self-> size = size;
+  ARRAY_STATS_SIZE(self, size);
 }
 
 void array_copy(int *copy, const int *copied, size_t size){
-  for(size_t i = 0; i<size; ++i){
-    copy[i] = copied[i];
-  }
+  if (size == 0) return;
+  memcpy(copy, copied, size * sizeof(int));
 }
 
-void array_create_from(struct array *self, const int *other, size_t size) {
-  self-> capacity = size*2;
+bool array_create_from(struct array *self, const int *other, size_t size) {
+  if (!array_init(self, (size > SIZE_MAX / 2) ? SIZE_MAX : size*2, NULL)) return false;
   self-> size = size;
-  self-> data = calloc(self-> capacity, sizeof(int));
   array_copy(self->data, other, size);
+  ARRAY_STATS_SIZE(self, size);
+  return true;
+}
+
+/*
+ * File-backed arrays: the data buffer is a shared mapping of the file, and the
+ * allocator of the array resizes it with ftruncate + mremap. The other buffers
+ * (scratch) come from malloc. While the array is open the file is as long as the
+ * capacity, it is trimmed to the size by array_sync and when the array is destroyed.
+ * A mapping cannot be empty: without elements the array uses its inline buffer and
+ * the file is mapped again when they no longer fit.
+ */
+struct array_mmap {
+  struct array_allocator allocator;
+  int fd;
+  void *map; // NULL while the elements are in the inline buffer
+};
+
+static void *array_mmap_alloc(void *context, size_t bytes) {
+  (void)context;
+  return malloc(bytes);
+}
+
+static void *array_mmap_realloc(void *context, void *ptr, size_t old_bytes, size_t new_bytes) {
+  struct array_mmap *self = context;
+  if (ptr != self->map) return realloc(ptr, new_bytes);
+  if (new_bytes == 0 || new_bytes > (size_t)INT64_MAX) return NULL;
+  // the slots past a smaller capacity must not stay in the file, it is cut before they are unmapped
+  if (new_bytes != old_bytes && ftruncate(self->fd, (off_t)new_bytes) != 0) return NULL;
+#ifdef MREMAP_MAYMOVE
+  void *map = mremap(ptr, old_bytes, new_bytes, MREMAP_MAYMOVE);
+#else
+  void *map = mmap(NULL, new_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, self->fd, 0);
+  if (map != MAP_FAILED) munmap(ptr, old_bytes);
+#endif
+  if (map == MAP_FAILED) {
+    int error = errno;
+    // the old mapping stays, so does its part of the file
+    if (new_bytes < old_bytes && ftruncate(self->fd, (off_t)old_bytes) == 0) errno = error;
+    return NULL;
+  }
+  self->map = map;
+  return map;
+}
+
+static void array_mmap_free(void *context, void *ptr, size_t bytes) {
+  struct array_mmap *self = context;
+  if (ptr != self->map) {
+    free(ptr);
+    return;
+  }
+  munmap(ptr, bytes);
+  self->map = NULL;
+}
+
+static bool array_is_mapped(const struct array *self) {
+  return self->allocator != NULL && self->allocator->alloc == array_mmap_alloc;
+}
+
+/*
+ * Map the file again for capacity elements, when they no longer fit in the inline buffer
+ */
+static int *array_mmap_map(struct array *self, size_t capacity) {
+  struct array_mmap *mapping = self->allocator->context;
+  size_t bytes = capacity * sizeof(int);
+  if (bytes > (size_t)INT64_MAX || ftruncate(mapping->fd, (off_t)bytes) != 0) return NULL;
+  void *map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, mapping->fd, 0);
+  if (map == MAP_FAILED) return NULL;
+  mapping->map = map;
+  return map;
+}
+
+bool array_open_mmap(struct array *self, const char *path, unsigned flags) {
+  bool read_only = (flags & ARRAY_MMAP_READ_ONLY) != 0;
+  int fd = open(path, read_only ? O_RDONLY : (O_RDWR | ((flags & ARRAY_MMAP_CREATE) ? O_CREAT : 0)), 0644);
+  if (fd < 0) return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  if ((size_t)st.st_size % sizeof(int) != 0) {
+    // the last bytes would not belong to any element
+    close(fd);
+    errno = EINVAL;
+    return false;
+  }
+  size_t size = (size_t)st.st_size / sizeof(int);
+  if (size == 0 && read_only) {
+    // nothing to map
+    close(fd);
+    array_init(self, 0, NULL);
+    return true;
+  }
+
+  struct array_mmap *mapping = malloc(sizeof(struct array_mmap));
+  void *map = NULL;
+  if (size > 0) {
+    map = mmap(NULL, size * sizeof(int), read_only ? PROT_READ : (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+  }
+  if (mapping == NULL || map == MAP_FAILED) {
+    if (map != MAP_FAILED && map != NULL) munmap(map, size * sizeof(int));
+    free(mapping);
+    close(fd);
+    return false;
+  }
+  mapping->allocator.alloc = array_mmap_alloc;
+  mapping->allocator.realloc = array_mmap_realloc;
+  mapping->allocator.free = array_mmap_free;
+  mapping->allocator.context = mapping;
+  mapping->fd = fd;
+  mapping->map = map;
+
+  array_init(self, 0, &mapping->allocator);
+  if (map != NULL) {
+    self->data = map;
+    self->capacity = size;
+    self->size = size;
+  }
+  return true;
+}
+
+static bool array_realloc(struct array *self, size_t capacity);
+
+/*
+ * Make the file hold the elements and nothing after them: the mapping is shrunk to the size,
+ * or given up for the inline buffer when there are no elements left
+ */
+static bool array_mmap_trim(struct array *self) {
+  struct array_mmap *mapping = self->allocator->context;
+  array_contiguous(self);
+  if (array_is_inline(self)) {
+    size_t bytes = self->size * sizeof(int);
+    return pwrite(mapping->fd, self->inline_data, bytes, 0) == (ssize_t)bytes
+      && ftruncate(mapping->fd, (off_t)bytes) == 0;
+  }
+  if (self->size == 0) {
+    array_deallocate(self, self->data, self->capacity * sizeof(int));
+    self->data = self->inline_data;
+    self->capacity = ARRAY_INLINE_CAPACITY;
+    return ftruncate(mapping->fd, 0) == 0;
+  }
+  return self->size == self->capacity || array_realloc(self, self->size);
+}
+
+bool array_sync(struct array *self) {
+  if (!array_is_mapped(self)) return true;
+  struct array_mmap *mapping = self->allocator->context;
+  if (!array_mmap_trim(self)) return false;
+  if (array_is_inline(self)) return fsync(mapping->fd) == 0;
+  return msync(self->data, self->capacity * sizeof(int), MS_SYNC) == 0;
+}
+
+/*
+ * Trim and close the file, the error is left in errno as array_destroy has no result
+ */
+static void array_mmap_close(struct array *self) {
+  struct array_mmap *mapping = self->allocator->context;
+  int error = 0;
+  if (!array_mmap_trim(self)) {
+    error = errno;
+    if (!array_is_inline(self)) {
+      // the mapping could not be shrunk, the file is cut to the elements once it is unmapped
+      munmap(self->data, self->capacity * sizeof(int));
+      mapping->map = NULL;
+      if (ftruncate(mapping->fd, (off_t)(self->size * sizeof(int))) == 0) error = 0;
+      else error = errno;
+    }
+  }
+  if (mapping->map != NULL) array_deallocate(self, self->data, self->capacity * sizeof(int));
+  if (close(mapping->fd) != 0 && error == 0) error = errno;
+  free(mapping);
+  if (error != 0) errno = error;
 }
 
 void array_destroy(struct array *self){
-  if(self-> data != NULL)free(self->data);
+  // the file is cut to the live elements, squeeze out the dead ones while their bitmap is there
+  if (array_is_mapped(self)) array_contiguous(self);
+  array_deallocate(self, self->scratch, self->scratch_capacity * sizeof(int));
+  array_deallocate(self, self->tombstones, array_tombstone_bytes(self));
+  if (array_is_mapped(self)) {
+    array_mmap_close(self);
+  } else if (!array_is_inline(self)) {
+    array_deallocate(self, self->data, self->capacity * sizeof(int));
+  }
+}
+
+void array_move(struct array *self, struct array *other) {
+  *self = *other;
+  if (array_is_inline(other)) self->data = self->inline_data;
+  // a mapping belongs to one array, other falls back to malloc
+  array_init(other, 0, array_is_mapped(other) ? NULL : other->allocator);
+}
+
+void array_swap_contents(struct array *self, struct array *other) {
+  bool self_inline = array_is_inline(self);
+  bool other_inline = array_is_inline(other);
+  struct array tmp = *self;
+  *self = *other;
+  *other = tmp;
+  if (other_inline) self->data = self->inline_data;
+  if (self_inline) other->data = other->inline_data;
 }
 
 bool array_empty(const struct array *self) {
@@ -46,185 +699,2191 @@ size_t array_size(const struct array *self) {
   return self-> size;
 }
 
-bool array_equals(const struct array *self, const int *content, size_t size) {
-  if(self-> size != size){
-    return false;
+/*
+ * Scan kernels: a portable scalar version, and SSE2/AVX2/AVX-512 versions on x86
+ * chosen at load time from what the CPU supports
+ */
+
+static size_t array_search_scalar(const int *data, size_t n, int value) {
+  size_t i = 0;
+  while (i < n && data[i] != value) {
+    i++;
   }
-  for(size_t i = 0; i < size; ++i){
-    if(self-> data[i] != content[i]){
-      return false;
+  return i;
+}
+
+static size_t array_mismatch_scalar(const int *a, const int *b, size_t n) {
+  size_t i = 0;
+  while (i < n && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+/*
+ * Check the parents from first to the end of the binary heap
+ */
+static bool array_is_heap_scalar(const int *data, size_t n, size_t first) {
+  for(size_t i=first; i<n;++i){
+    if(2*i+1<n){
+      if(data[i]<data[2*i+1])return false;
+      if(2*i+2<n){
+        if(data[i]<data[2*i+2])return false;
+      }
     }
   }
   return true;
 }
 
-void array_size_up(struct array *self,int *copied){
-  if(self->capacity <= 1) self-> capacity = 10;
-  else self-> capacity = self->size*2;
-  self->data = calloc(self->capacity,sizeof(int));
-  for(size_t i = 0; i<self->size; ++i){
-    self->data[i] = copied[i];
+/*
+ * Intersect the sorted ranges a and b into out after its first k values, each common value is written once
+ */
+static inline size_t array_intersect_tail(const int *a, size_t na, const int *b, size_t nb, int *out, size_t k) {
+  size_t i = 0;
+  size_t j = 0;
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (b[j] < a[i]) {
+      j++;
+    } else {
+      if (k == 0 || out[k - 1] != a[i]) out[k++] = a[i];
+      i++;
+      j++;
+    }
   }
+  return k;
 }
 
-void array_push_back(struct array *self, int value) {
-  if((self-> capacity-self-> size)<2) array_size_up(self, self->data);
-  self->data[self->size] = value;
-  self->size +=1;
+static size_t array_intersect_scalar(const int *a, size_t na, const int *b, size_t nb, int *out) {
+  return array_intersect_tail(a, na, b, nb, out, 0);
 }
 
-void array_pop_back(struct array *self) {
-  self-> data[self-> size-1] = 0;
-  self-> size = self-> size-1;
-}
+#if ARRAY_X86
 
-void array_insert(struct array *self, int value, size_t index) {
-  if((self-> capacity-self-> size)<2) array_size_up(self, self->data);
-  for(size_t i = self->size; i > index; --i){
-    self->data[i] = self-> data[i-1];
+__attribute__((target("sse2")))
+static size_t array_search_sse2(const int *data, size_t n, int value) {
+  const __m128i needle = _mm_set1_epi32(value);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i a = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(data + i)), needle);
+    __m128i b = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(data + i + 4)), needle);
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(a)) | (_mm_movemask_ps(_mm_castsi128_ps(b)) << 4);
+    if (mask != 0) return i + __builtin_ctz(mask);
   }
-  self->size +=1;
-  self->data[index] =  value;
+  return i + array_search_scalar(data + i, n - i, value);
 }
 
-void array_remove(struct array *self, size_t index) {
-  for(size_t i = index; i < self->size ; ++i){
-    self->data[i] = self-> data[i+1];
+__attribute__((target("sse2")))
+static size_t array_mismatch_sse2(const int *a, const int *b, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i lo = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(a + i)), _mm_loadu_si128((const __m128i *)(b + i)));
+    __m128i hi = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(a + i + 4)), _mm_loadu_si128((const __m128i *)(b + i + 4)));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(lo)) | (_mm_movemask_ps(_mm_castsi128_ps(hi)) << 4);
+    if (mask != 0xFF) return i + __builtin_ctz(~mask);
   }
-  self->size -=1;
+  return i + array_mismatch_scalar(a + i, b + i, n - i);
 }
 
-int array_get(const struct array *self, size_t index) {
-  if(index < self->size) return self-> data[index];
-  return 0;
+__attribute__((target("sse2")))
+static bool array_is_sorted_sse2(const int *data, size_t n) {
+  size_t i = 0;
+  for (; i + 9 <= n; i += 8) {
+    __m128i lo = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)(data + i)), _mm_loadu_si128((const __m128i *)(data + i + 1)));
+    __m128i hi = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)(data + i + 4)), _mm_loadu_si128((const __m128i *)(data + i + 5)));
+    if (_mm_movemask_epi8(_mm_or_si128(lo, hi)) != 0) return false;
+  }
+  return array_is_sorted_range(data + i, n - i);
 }
 
-void array_set(struct array *self, size_t index, int value) {
-  if(self-> size >= index){
-    self-> data[index] = value;
+/*
+ * The children of the parents j..j+3 are 2j+1..2j+8: each parent is duplicated to face its two children
+ */
+__attribute__((target("sse2")))
+static bool array_is_heap_sse2(const int *data, size_t n) {
+  size_t j = 0;
+  for (; 2 * j + 9 <= n; j += 4) {
+    __m128i parents = _mm_loadu_si128((const __m128i *)(data + j));
+    __m128i lo = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)(data + 2 * j + 1)), _mm_unpacklo_epi32(parents, parents));
+    __m128i hi = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i *)(data + 2 * j + 5)), _mm_unpackhi_epi32(parents, parents));
+    if (_mm_movemask_epi8(_mm_or_si128(lo, hi)) != 0) return false;
   }
+  return array_is_heap_scalar(data, n, j);
 }
 
-size_t array_search(const struct array *self, int value) {
+/*
+ * Block intersection: every element of a block of a is compared with every rotation of a block of b,
+ * then the block with the smaller maximum is skipped (both when they are equal)
+ */
+__attribute__((target("sse2")))
+static size_t array_intersect_sse2(const int *a, size_t na, const int *b, size_t nb, int *out) {
   size_t i = 0;
-  while (i < self-> size && self-> data[i] != value) {
-    i++;
+  size_t j = 0;
+  size_t k = 0;
+  while (i + 4 <= na && j + 4 <= nb) {
+    __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i vb = _mm_loadu_si128((const __m128i *)(b + j));
+    __m128i eq = _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi32(va, vb), _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x39))),
+      _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4E)), _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x93))));
+    unsigned mask = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(eq));
+    while (mask != 0) {
+      int value = a[i + __builtin_ctz(mask)];
+      if (k == 0 || out[k - 1] != value) out[k++] = value;
+      mask &= mask - 1;
+    }
+    int a_max = a[i + 3];
+    int b_max = b[j + 3];
+    i += (size_t)(a_max <= b_max) * 4;
+    j += (size_t)(b_max <= a_max) * 4;
   }
-  return i;
+  return array_intersect_tail(a + i, na - i, b + j, nb - j, out, k);
 }
 
+__attribute__((target("avx2")))
+static size_t array_search_avx2(const int *data, size_t n, int value) {
+  const __m256i needle = _mm256_set1_epi32(value);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m256i a = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(data + i)), needle);
+    __m256i b = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(data + i + 8)), needle);
+    unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(a)) | ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(b)) << 8);
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  return i + array_search_sse2(data + i, n - i, value);
+}
 
-size_t array_search_sorted(const struct array *self, int value) {
+__attribute__((target("avx2")))
+static size_t array_mismatch_avx2(const int *a, const int *b, size_t n) {
   size_t i = 0;
-  while (i < self-> size && self-> data[i] != value) {
-    i++;
+  for (; i + 16 <= n; i += 16) {
+    __m256i lo = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(a + i)), _mm256_loadu_si256((const __m256i *)(b + i)));
+    __m256i hi = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(a + i + 8)), _mm256_loadu_si256((const __m256i *)(b + i + 8)));
+    unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(lo)) | ((unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(hi)) << 8);
+    if (mask != 0xFFFF) return i + __builtin_ctz(~mask);
   }
-  return i;
+  return i + array_mismatch_sse2(a + i, b + i, n - i);
 }
 
-bool array_is_sorted(const struct array *self) {
-  for(size_t i = 1; i < self->size; ++i){
-    if(self->data[i] < self->data[i-1]) return false;
+__attribute__((target("avx2")))
+static bool array_is_sorted_avx2(const int *data, size_t n) {
+  size_t i = 0;
+  for (; i + 17 <= n; i += 16) {
+    __m256i lo = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i *)(data + i)), _mm256_loadu_si256((const __m256i *)(data + i + 1)));
+    __m256i hi = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i *)(data + i + 8)), _mm256_loadu_si256((const __m256i *)(data + i + 9)));
+    if (!_mm256_testz_si256(_mm256_or_si256(lo, hi), _mm256_or_si256(lo, hi))) return false;
   }
-  return true;
+  return array_is_sorted_sse2(data + i, n - i);
 }
 
-void array_swap(struct array *self, size_t i, size_t j){
-  int stock = self->data[i];
-  self->data[i] = self->data[j];
-  self->data[j] = stock;
+__attribute__((target("avx2")))
+static bool array_is_heap_avx2(const int *data, size_t n) {
+  const __m256i first = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+  const __m256i second = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+  size_t j = 0;
+  for (; 2 * j + 17 <= n; j += 8) {
+    __m256i parents = _mm256_loadu_si256((const __m256i *)(data + j));
+    __m256i lo = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i *)(data + 2 * j + 1)), _mm256_permutevar8x32_epi32(parents, first));
+    __m256i hi = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i *)(data + 2 * j + 9)), _mm256_permutevar8x32_epi32(parents, second));
+    if (!_mm256_testz_si256(_mm256_or_si256(lo, hi), _mm256_or_si256(lo, hi))) return false;
+  }
+  return array_is_heap_scalar(data, n, j);
 }
 
-ptrdiff_t array_partition(struct array *self, ptrdiff_t i, ptrdiff_t j) {
-  ptrdiff_t pivot_index = i;
-  const int pivot = self->data[pivot_index];
-  array_swap(self, pivot_index, j);
-  ptrdiff_t l = i;
-  for (ptrdiff_t k = i; k < j; ++k) {
-    if (self->data[k] < pivot) {
-      array_swap(self, k, l);
-      ++l;
+__attribute__((target("avx2")))
+static size_t array_intersect_avx2(const int *a, size_t na, const int *b, size_t nb, int *out) {
+  const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+  while (i + 8 <= na && j + 8 <= nb) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(b + j));
+    __m256i eq = _mm256_cmpeq_epi32(va, vb);
+    for (int r = 1; r < 8; ++r) {
+      vb = _mm256_permutevar8x32_epi32(vb, rotate);
+      eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(va, vb));
+    }
+    unsigned mask = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(eq));
+    while (mask != 0) {
+      int value = a[i + __builtin_ctz(mask)];
+      if (k == 0 || out[k - 1] != value) out[k++] = value;
+      mask &= mask - 1;
     }
+    int a_max = a[i + 7];
+    int b_max = b[j + 7];
+    i += (size_t)(a_max <= b_max) * 8;
+    j += (size_t)(b_max <= a_max) * 8;
   }
-  array_swap(self, l, j);
-  return l;
+  return array_intersect_tail(a + i, na - i, b + j, nb - j, out, k);
 }
 
-void array_quick_sort_partial(struct array *self,ptrdiff_t i, ptrdiff_t j) {
-  if (i < j) {
-    ptrdiff_t p = array_partition(self, i, j);
-    array_quick_sort_partial(self, i, p - 1);
-    array_quick_sort_partial(self, p + 1, j);
+__attribute__((target("avx512f")))
+static size_t array_search_avx512(const int *data, size_t n, int value) {
+  const __m512i needle = _mm512_set1_epi32(value);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __mmask16 mask = _mm512_cmpeq_epi32_mask(_mm512_loadu_si512(data + i), needle);
+    if (mask != 0) return i + __builtin_ctz(mask);
   }
+  return i + array_search_scalar(data + i, n - i, value);
 }
 
-void array_quick_sort(struct array *self){
-  array_quick_sort_partial(self,0,self->size-1);
+__attribute__((target("avx512f")))
+static size_t array_mismatch_avx512(const int *a, const int *b, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __mmask16 mask = _mm512_cmpneq_epi32_mask(_mm512_loadu_si512(a + i), _mm512_loadu_si512(b + i));
+    if (mask != 0) return i + __builtin_ctz(mask);
+  }
+  return i + array_mismatch_scalar(a + i, b + i, n - i);
 }
 
-void heapify(struct array *self, int n, int i){
-    int largest = i;
-    int l = 2 * i + 1;
-    int r = 2 * i + 2;
-    if (l < n && self->data[l] > self->data[largest])largest = l;
-    if (r < n && self->data[r] > self->data[largest])largest = r;
-    if (largest != i) {
-        array_swap(self,i,largest);
-         heapify(self, n, largest);
-    }
+__attribute__((target("avx512f")))
+static bool array_is_sorted_avx512(const int *data, size_t n) {
+  size_t i = 0;
+  for (; i + 17 <= n; i += 16) {
+    if (_mm512_cmpgt_epi32_mask(_mm512_loadu_si512(data + i), _mm512_loadu_si512(data + i + 1)) != 0) return false;
+  }
+  return array_is_sorted_range(data + i, n - i);
 }
 
-void array_heap_sort(struct array *self){
-  int n = (int)(self->size);
-  for (int i = n / 2 - 1; i >= 0; i--) heapify(self, n, i);
-  for (int i = n - 1; i > 0; i--){
-      array_swap(self,0,i);
-      heapify(self, i, 0);
+__attribute__((target("avx512f")))
+static bool array_is_heap_avx512(const int *data, size_t n) {
+  const __m512i first = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+  const __m512i second = _mm512_setr_epi32(8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13, 14, 14, 15, 15);
+  size_t j = 0;
+  for (; 2 * j + 33 <= n; j += 16) {
+    __m512i parents = _mm512_loadu_si512(data + j);
+    __mmask16 lo = _mm512_cmpgt_epi32_mask(_mm512_loadu_si512(data + 2 * j + 1), _mm512_permutexvar_epi32(first, parents));
+    __mmask16 hi = _mm512_cmpgt_epi32_mask(_mm512_loadu_si512(data + 2 * j + 17), _mm512_permutexvar_epi32(second, parents));
+    if ((lo | hi) != 0) return false;
   }
+  return array_is_heap_scalar(data, n, j);
 }
 
-bool array_is_heap(const struct array *self) {
-  for(size_t i=0; i<self->size;++i){
-    if(2*i+1<self->size){
-      if(self->data[i]<self->data[2*i+1])return false;
-      if(2*i+2<self->size){
-        if(self->data[i]<self->data[2*i+2])return false;
-      }
-    }
-  }
-  return true;
+#endif // ARRAY_X86
+
+struct array_kernels {
+  size_t (*search)(const int *data, size_t n, int value);
+  size_t (*mismatch)(const int *a, const int *b, size_t n);
+  bool (*is_sorted)(const int *data, size_t n);
+  bool (*is_heap)(const int *data, size_t n);
+  size_t (*intersect)(const int *a, size_t na, const int *b, size_t nb, int *out);
+};
+
+static bool array_is_heap_scalar_all(const int *data, size_t n) {
+  return array_is_heap_scalar(data, n, 0);
 }
 
-void array_heap_add(struct array *self, int value) {
-  size_t i = self->size;
-  array_push_back(self,value);
-  while (i > 0) {
-    size_t j = (i - 1) / 2;
-    if (self->data[i] < self->data[j]) {
-      break;
-    }
-    array_swap(self, i, j);
-    i = j;
+static const struct array_kernels array_kernels_scalar = {
+  array_search_scalar, array_mismatch_scalar, array_is_sorted_range, array_is_heap_scalar_all, array_intersect_scalar,
+};
+
+#if ARRAY_X86
+static const struct array_kernels array_kernels_sse2 = {
+  array_search_sse2, array_mismatch_sse2, array_is_sorted_sse2, array_is_heap_sse2, array_intersect_sse2,
+};
+
+static const struct array_kernels array_kernels_avx2 = {
+  array_search_avx2, array_mismatch_avx2, array_is_sorted_avx2, array_is_heap_avx2, array_intersect_avx2,
+};
+
+// the block intersection needs lane rotations, the AVX2 version is used on AVX-512 machines
+static const struct array_kernels array_kernels_avx512 = {
+  array_search_avx512, array_mismatch_avx512, array_is_sorted_avx512, array_is_heap_avx512, array_intersect_avx2,
+};
+#endif
+
+static const struct array_kernels *array_kernels = &array_kernels_scalar;
+
+enum array_simd array_simd_select(enum array_simd max) {
+#if ARRAY_X86
+  __builtin_cpu_init();
+  if (max >= ARRAY_SIMD_AVX512 && __builtin_cpu_supports("avx512f")) {
+    array_kernels = &array_kernels_avx512;
+    return ARRAY_SIMD_AVX512;
+  }
+  if (max >= ARRAY_SIMD_AVX2 && __builtin_cpu_supports("avx2")) {
+    array_kernels = &array_kernels_avx2;
+    return ARRAY_SIMD_AVX2;
+  }
+  if (max >= ARRAY_SIMD_SSE2 && __builtin_cpu_supports("sse2")) {
+    array_kernels = &array_kernels_sse2;
+    return ARRAY_SIMD_SSE2;
   }
+#endif
+  (void)max;
+  array_kernels = &array_kernels_scalar;
+  return ARRAY_SIMD_SCALAR;
 }
 
-int array_heap_top(const struct array *self) {
-  return self->data[0];
+__attribute__((constructor))
+static void array_simd_init(void) {
+  array_simd_select(ARRAY_SIMD_AVX512);
 }
 
-void array_heap_remove_top(struct array *self) {
-  size_t n = (int)(self->size);
-  self->data[0] = self->data[n-1];
-  size_t i =0;
-  while (i < ((n)/2)){
-    size_t lt = 2 * i + 1;
-    size_t rt = 2 * i + 2;
-    if (self->data[i] > self->data[lt] && self->data[i] > self->data[rt]) {
-      break;
-    }
-    size_t j = (self->data[lt] > self->data[rt]) ? lt : rt;
-    array_swap(self, i, j);
-    i = j;
+bool array_equals(const struct array *self, const int *content, size_t size) {
+  if(self-> size != size){
+    return false;
   }
-  array_pop_back(self);
-}
\ No newline at end of file
+  for (size_t slot = 0, n; (n = array_run(self, &slot)) != 0; slot += n) {
+    if (array_kernels->mismatch(self->data + slot, content, n) != n) return false;
+    content += n;
+  }
+  return true;
+}
+
+void array_set_growth(struct array *self, enum array_growth growth, size_t chunk) {
+  self->growth = growth;
+  self->growth_chunk = chunk;
+}
+
+static size_t array_next_capacity(const struct array *self, size_t needed) {
+  return array_grown_capacity(self->capacity, self->growth, self->growth_chunk, needed);
+}
+
+/*
+ * Get a scratch buffer of at least n elements, kept in the array so that it can be reused by the next call
+ */
+static int *array_scratch(struct array *self, size_t n) {
+  if (n <= self->scratch_capacity) return self->scratch;
+  if (n > SIZE_MAX / sizeof(int)) return NULL;
+  int *scratch = array_allocate(self, n * sizeof(int));
+  if (scratch == NULL) return NULL;
+  array_deallocate(self, self->scratch, self->scratch_capacity * sizeof(int));
+  self->scratch = scratch;
+  self->scratch_capacity = n;
+  return scratch;
+}
+
+static bool array_realloc(struct array *self, size_t capacity) {
+  // the tombstones are sized for the capacity
+  if (self->dead != 0) array_compact_tombstones(self);
+  if (capacity > SIZE_MAX / sizeof(int)) return false;
+  int *data;
+  if (array_is_inline(self)) {
+    // spill the inline elements to the heap (to the file for a file-backed array)
+    data = array_is_mapped(self) ? array_mmap_map(self, capacity) : array_allocate(self, capacity * sizeof(int));
+    if (data == NULL) return false;
+    memcpy(data, self->inline_data, (self->size + self->gap_size) * sizeof(int));
+  } else {
+    data = array_reallocate(self, self->data, self->capacity * sizeof(int), capacity * sizeof(int));
+  }
+  if (data == NULL) return false;
+  ARRAY_STATS_RESIZE(self, (data != self->data) ? self->size + self->gap_size : 0, capacity);
+  self->data = data;
+  self->capacity = capacity;
+  return true;
+}
+
+bool array_size_up(struct array *self, size_t needed){
+  if (needed <= self->capacity) return true;
+  if (self->dead != 0) {
+    // needed counts the dead slots, that may be enough room
+    needed -= self->dead;
+    array_compact_tombstones(self);
+    if (needed <= self->capacity) return true;
+  }
+  return array_realloc(self, array_next_capacity(self, needed));
+}
+
+bool array_reserve(struct array *self, size_t n) {
+  ARRAY_STATS_SIZE(self, n);
+  if (n <= self->capacity) return true;
+  return array_realloc(self, n);
+}
+
+void array_shrink_to_fit(struct array *self) {
+  array_deallocate(self, self->scratch, self->scratch_capacity * sizeof(int));
+  self->scratch = NULL;
+  self->scratch_capacity = 0;
+  array_contiguous(self);
+  if (array_is_inline(self) || self->size == self->capacity) return;
+  if (array_is_mapped(self)) {
+    array_mmap_trim(self);
+    return;
+  }
+  if (self->size <= ARRAY_INLINE_CAPACITY) {
+    memcpy(self->inline_data, self->data, self->size * sizeof(int));
+    array_deallocate(self, self->data, self->capacity * sizeof(int));
+    self->data = self->inline_data;
+    self->capacity = ARRAY_INLINE_CAPACITY;
+    ARRAY_STATS_RESIZE(self, self->size, ARRAY_INLINE_CAPACITY);
+    return;
+  }
+  array_realloc(self, self->size);
+}
+
+/*
+ * Get the slot of an element: the ones from the gap on are stored after it
+ */
+static inline int *array_slot(const struct array *self, size_t index) {
+  if (self->dead != 0) return self->data + array_tombstone_select(self, index);
+  return self->data + index + (size_t)(index >= self->gap) * self->gap_size;
+}
+
+/*
+ * Move the gap in front of the element at index
+ */
+static void array_move_gap(struct array *self, size_t index) {
+  // an empty gap has nothing to move, and its position may be stale after edits outside gap mode
+  if (self->gap_size == 0) {
+    self->gap = index;
+    return;
+  }
+  if (index < self->gap) {
+    memmove(self->data + index + self->gap_size, self->data + index, (self->gap - index) * sizeof(int));
+  } else if (index > self->gap) {
+    memmove(self->data + self->gap, self->data + self->gap + self->gap_size, (index - self->gap) * sizeof(int));
+  }
+  self->gap = index;
+}
+
+/*
+ * Move the gap in front of the element at index and make it at least k slots wide: after a growth
+ * the gap takes all the free slots, so the next edits around it do not move anything
+ */
+static bool array_open_gap(struct array *self, size_t index, size_t k) {
+  array_move_gap(self, index);
+  if (self->gap_size >= k) return true;
+  if (!array_size_up(self, self->size + k)) return false;
+  size_t gap_size = self->capacity - self->size;
+  memmove(self->data + self->gap + gap_size, self->data + self->gap + self->gap_size, (self->size - self->gap) * sizeof(int));
+  self->gap_size = gap_size;
+  return true;
+}
+
+/*
+ * Mark the element at index as dead, the slots are squeezed out once too many of them are dead
+ */
+static void array_remove_lazily(struct array *self, size_t index) {
+  if (self->tombstones == NULL) {
+    self->tombstones = array_allocate(self, array_tombstone_bytes(self));
+    if (self->tombstones == NULL) {
+      // no room for the bitmap, remove right away
+      memmove(self->data + index, self->data + index + 1, (self->size - index - 1) * sizeof(int));
+      self->size -= 1;
+      return;
+    }
+    memset(self->tombstones, 0, array_tombstone_bytes(self));
+  }
+  array_tombstone_mark(self, (size_t)(array_slot(self, index) - self->data));
+  self->dead += 1;
+  self->size -= 1;
+  if (self->dead * ARRAY_COMPACT_THRESHOLD > self->size + self->dead) array_compact(self);
+}
+
+void array_set_storage(struct array *self, enum array_storage storage) {
+  if (storage != self->storage) array_contiguous(self);
+  // the edits outside gap mode do not maintain the gap, put the empty one back at the end
+  if (self->gap_size == 0) self->gap = self->size;
+  self->storage = storage;
+}
+
+void array_clear(struct array *self) {
+  array_deallocate(self, self->tombstones, array_tombstone_bytes(self));
+  self->tombstones = NULL;
+  self->dead = 0;
+  self->size = 0;
+  self->gap = 0;
+  self->gap_size = 0;
+  self->sorted = false;
+}
+
+void array_compact(struct array *self) {
+  if (self->dead != 0) array_compact_tombstones(self);
+}
+
+/*
+ * Tell if the array stays sorted when the k elements of src are inserted at index
+ */
+static bool array_keeps_sorted(const struct array *self, size_t index, const int *src, size_t k) {
+  if (!self->sorted || k == 0) return self->sorted;
+  if (index > 0 && *array_slot(self, index - 1) > src[0]) return false;
+  if (index < self->size && *array_slot(self, index) < src[k - 1]) return false;
+  return k == 1 || array_kernels->is_sorted(src, k);
+}
+
+void array_push_back(struct array *self, int value) {
+  if (!array_size_up(self, array_used(self) + 1)) return;
+  self->sorted = array_keeps_sorted(self, self->size, &value, 1);
+  self->data[array_used(self)] = value;
+  self->size +=1;
+  ARRAY_STATS_SIZE(self, self->size);
+}
+
+void array_pop_back(struct array *self) {
+  if (self->storage == ARRAY_STORAGE_TOMBSTONES) {
+    array_remove_lazily(self, self->size - 1);
+    return;
+  }
+  *array_slot(self, self->size - 1) = 0;
+  if (self->storage == ARRAY_STORAGE_GAP_BUFFER && self->gap == self->size) {
+    // the last element is before the gap, it becomes part of it
+    self->gap -= 1;
+    self->gap_size += 1;
+  }
+  self-> size = self-> size-1;
+}
+
+void array_insert(struct array *self, int value, size_t index) {
+  array_compact(self);
+  self->sorted = array_keeps_sorted(self, index, &value, 1);
+  if (self->storage == ARRAY_STORAGE_GAP_BUFFER) {
+    if (!array_open_gap(self, index, 1)) return;
+    self->data[self->gap] = value;
+    self->gap += 1;
+    self->gap_size -= 1;
+    self->size += 1;
+    ARRAY_STATS_SIZE(self, self->size);
+    return;
+  }
+  if (!array_size_up(self, self->size + 1)) return;
+  memmove(self->data + index + 1, self->data + index, (self->size - index) * sizeof(int));
+  self->size +=1;
+  self->data[index] =  value;
+  ARRAY_STATS_SIZE(self, self->size);
+}
+
+void array_remove(struct array *self, size_t index) {
+  if (self->storage == ARRAY_STORAGE_TOMBSTONES) {
+    array_remove_lazily(self, index);
+    return;
+  }
+  if (self->storage == ARRAY_STORAGE_GAP_BUFFER) {
+    array_move_gap(self, index);
+    self->gap_size += 1;
+    self->size -= 1;
+    return;
+  }
+  memmove(self->data + index, self->data + index + 1, (self->size - index - 1) * sizeof(int));
+  self->size -=1;
+}
+
+void array_append_range(struct array *self, const int *src, size_t k) {
+  if (!array_size_up(self, array_used(self) + k)) return;
+  self->sorted = array_keeps_sorted(self, self->size, src, k);
+  memcpy(self->data + array_used(self), src, k * sizeof(int));
+  self->size += k;
+  ARRAY_STATS_SIZE(self, self->size);
+}
+
+void array_insert_range(struct array *self, size_t index, const int *src, size_t k) {
+  if (index > self->size) return;
+  array_compact(self);
+  self->sorted = array_keeps_sorted(self, index, src, k);
+  if (self->storage == ARRAY_STORAGE_GAP_BUFFER) {
+    if (!array_open_gap(self, index, k)) return;
+    memcpy(self->data + self->gap, src, k * sizeof(int));
+    self->gap += k;
+    self->gap_size -= k;
+    self->size += k;
+    ARRAY_STATS_SIZE(self, self->size);
+    return;
+  }
+  if (!array_size_up(self, self->size + k)) return;
+  memmove(self->data + index + k, self->data + index, (self->size - index) * sizeof(int));
+  memcpy(self->data + index, src, k * sizeof(int));
+  self->size += k;
+  ARRAY_STATS_SIZE(self, self->size);
+}
+
+void array_erase_range(struct array *self, size_t first, size_t last) {
+  if (first >= last || last > self->size) return;
+  // a whole range is cheaper to close with one move than to mark dead slot by slot
+  array_compact(self);
+  if (self->storage == ARRAY_STORAGE_GAP_BUFFER) {
+    array_move_gap(self, first);
+    self->gap_size += last - first;
+    self->size -= last - first;
+    return;
+  }
+  memmove(self->data + first, self->data + last, (self->size - last) * sizeof(int));
+  self->size -= last - first;
+}
+
+int array_get(const struct array *self, size_t index) {
+  if(index < self->size) return *array_slot(self, index);
+  return 0;
+}
+
+void array_set(struct array *self, size_t index, int value) {
+  if(index < self-> size){
+    if (self->sorted) {
+      self->sorted = (index == 0 || *array_slot(self, index - 1) <= value)
+        && (index + 1 == self->size || value <= *array_slot(self, index + 1));
+    }
+    *array_slot(self, index) = value;
+  }
+}
+
+size_t array_search(const struct array *self, int value) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SEARCH);
+  size_t index = 0;
+  for (size_t slot = 0, n; (n = array_run(self, &slot)) != 0; slot += n) {
+    size_t i = array_kernels->search(self->data + slot, n, value);
+    if (i < n) return index + i;
+    index += n;
+  }
+  return self->size;
+}
+/*
+ * Binary search through array_slot, for the elements that are not contiguous
+ */
+static size_t array_bound_slots(const struct array *self, int value, bool upper) {
+  size_t first = 0;
+  size_t n = self->size;
+  while (n > 0) {
+    size_t half = n / 2;
+    if (array_before(*array_slot(self, first + half), value, upper)) {
+      first += half + 1;
+      n -= half + 1;
+    } else {
+      n = half;
+    }
+  }
+  return first;
+}
+
+size_t array_lower_bound(const struct array *self, int value) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SEARCH);
+  if (!array_is_contiguous(self)) return array_bound_slots(self, value, false);
+  return array_bound(self->data, self->size, value, false);
+}
+
+size_t array_upper_bound(const struct array *self, int value) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SEARCH);
+  if (!array_is_contiguous(self)) return array_bound_slots(self, value, true);
+  return array_bound(self->data, self->size, value, true);
+}
+
+size_t array_search_sorted(const struct array *self, int value) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SEARCH);
+  size_t i = array_lower_bound(self, value);
+  if (i < self->size && *array_slot(self, i) == value) return i;
+  return self->size;
+}
+
+/*
+ * Scan the runs, and the boundary between each run and the next one
+ */
+static bool array_scan_sorted(const struct array *self) {
+  const int *previous = NULL;
+  for (size_t slot = 0, n; (n = array_run(self, &slot)) != 0; slot += n) {
+    if (previous != NULL && self->data[slot] < *previous) return false;
+    if (!array_kernels->is_sorted(self->data + slot, n)) return false;
+    previous = self->data + slot + n - 1;
+  }
+  return true;
+}
+
+bool array_is_sorted(const struct array *self) {
+  // the flag is only ever set when the order is known, a cleared one still needs the scan
+  if (self->sorted_cache && self->sorted) return true;
+  return array_scan_sorted(self);
+}
+
+void array_cache_sorted(struct array *self, bool enabled) {
+  // the elements may have been written directly while the cache was off
+  if (enabled && !self->sorted_cache) self->sorted = array_scan_sorted(self);
+  self->sorted_cache = enabled;
+}
+
+/*
+ * When one input is this many times larger than the other, the set operations walk the smaller one
+ * and gallop through the larger one instead of merging element by element
+ */
+#define ARRAY_GALLOP_RATIO 32
+
+static bool array_is_skewed(size_t small, size_t large) {
+  return small < large / ARRAY_GALLOP_RATIO;
+}
+
+/*
+ * Empty out, give it room for n elements and run op on the elements of a and b in order: op writes straight
+ * into the buffer of out and returns the number of elements written
+ */
+static bool array_set_operation(const struct array *a, const struct array *b, struct array *out, size_t n,
+    size_t (*op)(const int *x, size_t na, const int *y, size_t nb, int *o)) {
+  if (out == a || out == b) return false;
+  array_clear(out);
+  if (!array_reserve(out, n)) return false;
+  const int *x;
+  const int *y;
+  if (!array_view(a, &x)) return false;
+  if (!array_view(b, &y)) {
+    array_release_view(a, x);
+    return false;
+  }
+  out->size = op(x, a->size, y, b->size, out->data);
+  array_release_view(a, x);
+  array_release_view(b, y);
+  return true;
+}
+
+/*
+ * Append the sorted range src to out after its first k values, skipping the values already written
+ */
+static size_t array_append_unique(int *out, size_t k, const int *src, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    if (k == 0 || out[k - 1] != src[i]) out[k++] = src[i];
+  }
+  return k;
+}
+
+static size_t array_merge_sorted(const int *x, size_t na, const int *y, size_t nb, int *out) {
+  int *o = out;
+  size_t i = 0;
+  size_t j = 0;
+  if (array_is_skewed(nb, na)) {
+    // copy the run of a that goes before each element of b (equal elements of a come first)
+    for (; j < nb; ++j) {
+      size_t run = array_gallop(x + i, na - i, y[j], true);
+      memcpy(o, x + i, run * sizeof(int));
+      o += run;
+      i += run;
+      *o++ = y[j];
+    }
+  } else if (array_is_skewed(na, nb)) {
+    for (; i < na; ++i) {
+      size_t run = array_gallop(y + j, nb - j, x[i], false);
+      memcpy(o, y + j, run * sizeof(int));
+      o += run;
+      j += run;
+      *o++ = x[i];
+    }
+  } else {
+    while (i < na && j < nb) {
+      bool take_b = y[j] < x[i];
+      *o++ = take_b ? y[j] : x[i];
+      j += take_b;
+      i += !take_b;
+    }
+  }
+  memcpy(o, x + i, (na - i) * sizeof(int));
+  o += na - i;
+  memcpy(o, y + j, (nb - j) * sizeof(int));
+  o += nb - j;
+  return (size_t)(o - out);
+}
+
+bool array_merge(const struct array *a, const struct array *b, struct array *out) {
+  return array_set_operation(a, b, out, a->size + b->size, array_merge_sorted);
+}
+
+static size_t array_union_sorted(const int *x, size_t na, const int *y, size_t nb, int *o) {
+  if (na > nb) {
+    // the union is symmetric, let x be the smaller input
+    const int *t = x; x = y; y = t;
+    size_t tn = na; na = nb; nb = tn;
+  }
+  size_t k = 0;
+  size_t i = 0;
+  size_t j = 0;
+  if (array_is_skewed(na, nb)) {
+    for (; i < na; ++i) {
+      size_t run = array_gallop(y + j, nb - j, x[i], false);
+      k = array_append_unique(o, k, y + j, run);
+      j += run;
+      if (k == 0 || o[k - 1] != x[i]) o[k++] = x[i];
+    }
+  } else {
+    while (i < na && j < nb) {
+      int value = (y[j] < x[i]) ? y[j] : x[i];
+      if (k == 0 || o[k - 1] != value) o[k++] = value;
+      i += (x[i] == value);
+      j += (y[j] == value);
+    }
+    k = array_append_unique(o, k, x + i, na - i);
+  }
+  return array_append_unique(o, k, y + j, nb - j);
+}
+
+bool array_set_union(const struct array *a, const struct array *b, struct array *out) {
+  return array_set_operation(a, b, out, a->size + b->size, array_union_sorted);
+}
+
+static size_t array_intersection_sorted(const int *x, size_t na, const int *y, size_t nb, int *o) {
+  if (na > nb) {
+    const int *t = x; x = y; y = t;
+    size_t tn = na; na = nb; nb = tn;
+  }
+  if (!array_is_skewed(na, nb)) return array_kernels->intersect(x, na, y, nb, o);
+  size_t k = 0;
+  size_t j = 0;
+  for (size_t i = 0; i < na && j < nb; ++i) {
+    if (k > 0 && o[k - 1] == x[i]) continue;
+    j += array_gallop(y + j, nb - j, x[i], false);
+    if (j < nb && y[j] == x[i]) o[k++] = x[i];
+  }
+  return k;
+}
+
+bool array_set_intersection(const struct array *a, const struct array *b, struct array *out) {
+  return array_set_operation(a, b, out, (a->size < b->size) ? a->size : b->size, array_intersection_sorted);
+}
+
+static size_t array_difference_sorted(const int *x, size_t na, const int *y, size_t nb, int *o) {
+  size_t k = 0;
+  size_t i = 0;
+  size_t j = 0;
+  if (array_is_skewed(na, nb)) {
+    // look each value of a up in b
+    for (; i < na && j < nb; ++i) {
+      j += array_gallop(y + j, nb - j, x[i], false);
+      if ((j == nb || y[j] != x[i]) && (k == 0 || o[k - 1] != x[i])) o[k++] = x[i];
+    }
+  } else if (array_is_skewed(nb, na)) {
+    // keep the run of a before each value of b, then skip the values of a equal to it
+    for (; j < nb && i < na; ++j) {
+      size_t run = array_gallop(x + i, na - i, y[j], false);
+      k = array_append_unique(o, k, x + i, run);
+      i += run;
+      i += array_gallop(x + i, na - i, y[j], true);
+    }
+  } else {
+    while (i < na && j < nb) {
+      if (x[i] < y[j]) {
+        if (k == 0 || o[k - 1] != x[i]) o[k++] = x[i];
+        i++;
+      } else if (y[j] < x[i]) {
+        j++;
+      } else {
+        i++;
+      }
+    }
+  }
+  return array_append_unique(o, k, x + i, na - i);
+}
+
+bool array_set_difference(const struct array *a, const struct array *b, struct array *out) {
+  return array_set_operation(a, b, out, a->size, array_difference_sorted);
+}
+
+void array_sorted_insert(struct array *self, int value) {
+  array_compact(self);
+  // look on the side of the gap where the value goes, the gap stays where it is
+  size_t before = (self->gap_size != 0) ? self->gap : self->size;
+  const int *after = self->data + before + self->gap_size;
+  size_t index;
+  if (before < self->size && *after <= value) {
+    index = before + array_bound(after, self->size - before, value, true);
+  } else {
+    index = array_bound(self->data, before, value, true);
+  }
+  array_insert(self, value, index);
+}
+
+void array_sorted_insert_batch(struct array *self, const int *src, size_t k) {
+  if (k == 0) return;
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_COUNT);
+  int *batch = array_scratch(self, k);
+  if (batch == NULL) {
+    for (size_t i = 0; i < k; ++i) array_sorted_insert(self, src[i]);
+    return;
+  }
+  memcpy(batch, src, k * sizeof(int));
+  struct array view = { .data = batch, .capacity = k, .size = k };
+  array_quick_sort(&view);
+
+  array_contiguous(self);
+  if (!array_size_up(self, self->size + k)) return;
+  // from the largest value of the batch down: the elements after its place move up once, straight to
+  // their final slot, and the search for the next place starts from there
+  int *data = self->data;
+  size_t n = self->size;
+  for (size_t j = k; j-- > 0;) {
+    size_t index = array_gallop_back(data, n, batch[j], true);
+    memmove(data + index + j + 1, data + index, (n - index) * sizeof(int));
+    data[index + j] = batch[j];
+    n = index;
+  }
+  self->size += k;
+  ARRAY_STATS_SIZE(self, self->size);
+}
+
+void array_swap(struct array *self, size_t i, size_t j){
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_COUNT);
+  array_contiguous(self);
+  self->sorted = false;
+  array_swap_elements(self->data, i, j);
+}
+
+ptrdiff_t array_partition(struct array *self, ptrdiff_t i, ptrdiff_t j) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_COUNT);
+  array_contiguous(self);
+  self->sorted = false;
+  return array_partition_range(self->data, i, j);
+}
+
+void array_quick_sort_partial(struct array *self,ptrdiff_t i, ptrdiff_t j) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SORT);
+  array_contiguous(self);
+  self->sorted = false;
+  if (i < j) {
+    array_intro_sort(self->data, i, j, 2 * array_log2((size_t)(j - i + 1)));
+  }
+}
+
+void array_quick_sort(struct array *self){
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SORT);
+  array_quick_sort_partial(self,0,self->size-1);
+  self->sorted = true;
+}
+
+void array_nth_element(struct array *self, size_t k) {
+  if (k >= self->size) return;
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SORT);
+  array_contiguous(self);
+  self->sorted = false;
+  array_select(self->data, self->size, k);
+}
+
+void array_partial_sort(struct array *self, size_t k) {
+  if (k == 0) return;
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SORT);
+  if (k >= self->size) {
+    array_quick_sort(self);
+    return;
+  }
+  array_nth_element(self, k - 1);
+  array_quick_sort_partial(self, 0, (ptrdiff_t)k - 2);
+}
+
+/*
+ * Pattern-defeating quick sort (pdqsort, Orson Peters): the partition is branchless (BlockQuicksort,
+ * Edelkamp and Weiss: the comparisons of a block only write down the offsets of the misplaced
+ * elements, which are swapped afterwards), a range that the pivot left partitioned is finished
+ * with an insertion sort that gives up after a few moves, the ranges equal to the previous pivot
+ * are put aside in one pass, and a few elements are shuffled when a partition is too unbalanced
+ * (heap sort once that happened log2(n) times)
+ */
+#define ARRAY_PDQ_INSERTION_SORT_THRESHOLD 24
+#define ARRAY_PDQ_BLOCK_SIZE 64
+#define ARRAY_PDQ_PARTIAL_INSERTION_LIMIT 8
+
+static inline void array_exchange(int *a, int *b) {
+  int tmp = *a;
+  *a = *b;
+  *b = tmp;
+}
+
+static inline void array_sort2(int *a, int *b) {
+  int x = *a;
+  int y = *b;
+  *a = (y < x) ? y : x;
+  *b = (y < x) ? x : y;
+}
+
+static inline void array_sort3(int *a, int *b, int *c) {
+  array_sort2(a, b);
+  array_sort2(b, c);
+  array_sort2(a, b);
+}
+
+/*
+ * Insertion sort of a range that follows an element not greater than any of its elements, which stops the shifts
+ */
+static void array_unguarded_insertion_sort(int *data, size_t n) {
+  for (size_t i = 1; i < n; ++i) {
+    int value = data[i];
+    int *hole = data + i;
+    while (value < hole[-1]) {
+      *hole = hole[-1];
+      --hole;
+    }
+    ARRAY_STATS_COMPARE((uint64_t)(data + i - hole) + 1);
+    *hole = value;
+  }
+}
+
+/*
+ * Insertion sort that gives up (returns false) once it moved too many elements
+ */
+static bool array_partial_insertion_sort(int *data, size_t n) {
+  size_t moved = 0;
+  for (size_t i = 1; i < n; ++i) {
+    ARRAY_STATS_COMPARE(1);
+    if (data[i] < data[i - 1]) {
+      int value = data[i];
+      size_t j = i;
+      do {
+        data[j] = data[j - 1];
+        --j;
+      } while (j > 0 && value < data[j - 1]);
+      data[j] = value;
+      moved += i - j;
+      ARRAY_STATS_COMPARE(i - j);
+      if (moved > ARRAY_PDQ_PARTIAL_INSERTION_LIMIT) return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * Offsets from first of the elements of the block that belong after the pivot, the count is the only thing the comparison changes
+ */
+static inline size_t array_pdq_offsets_left(const int *first, size_t n, int pivot, unsigned char *offsets) {
+  size_t num = 0;
+  for (size_t i = 0; i < n; ++i) {
+    offsets[num] = (unsigned char)i;
+    num += !(first[i] < pivot);
+  }
+  return num;
+}
+
+/*
+ * Offsets back from last of the elements of the block that belong before the pivot
+ */
+static inline size_t array_pdq_offsets_right(const int *last, size_t n, int pivot, unsigned char *offsets) {
+  size_t num = 0;
+  for (size_t i = 1; i <= n; ++i) {
+    offsets[num] = (unsigned char)i;
+    num += last[-(ptrdiff_t)i] < pivot;
+  }
+  return num;
+}
+
+/*
+ * Exchange the misplaced elements pairwise. Unless both sides have as many, they are moved as one cycle
+ * (one move per element instead of three), the swaps keep a reversed range in order for the next partitions
+ */
+static void array_pdq_swap_offsets(int *first, int *last, const unsigned char *offsets_l, const unsigned char *offsets_r, size_t num, bool use_swaps) {
+  if (use_swaps) {
+    for (size_t i = 0; i < num; ++i) {
+      array_exchange(first + offsets_l[i], last - offsets_r[i]);
+    }
+  } else if (num > 0) {
+    int *l = first + offsets_l[0];
+    int *r = last - offsets_r[0];
+    int tmp = *l;
+    *l = *r;
+    for (size_t i = 1; i < num; ++i) {
+      l = first + offsets_l[i];
+      *r = *l;
+      r = last - offsets_r[i];
+      *l = *r;
+    }
+    *r = tmp;
+  }
+}
+
+/*
+ * Partition [begin, end) around the pivot at begin: the smaller elements go before it and the others after,
+ * returns its final place. already_partitioned tells that nothing had to be moved
+ */
+static int *array_pdq_partition_right(int *begin, int *end, bool *already_partitioned) {
+  int pivot = *begin;
+  int *first = begin;
+  int *last = end;
+
+  // the median of three left an element not less than the pivot after it, and one not greater at the end
+  while (*++first < pivot) {
+  }
+  if (first - 1 == begin) {
+    while (first < last && !(*--last < pivot)) {
+    }
+  } else {
+    while (!(*--last < pivot)) {
+    }
+  }
+
+  *already_partitioned = first >= last;
+  if (!*already_partitioned) {
+    array_exchange(first, last);
+    ++first;
+
+    unsigned char offsets_l[ARRAY_PDQ_BLOCK_SIZE] __attribute__((aligned(64)));
+    unsigned char offsets_r[ARRAY_PDQ_BLOCK_SIZE] __attribute__((aligned(64)));
+    int *base_l = first;
+    int *base_r = last;
+    size_t num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+    while (first < last) {
+      // a side whose offsets are all used scans a new block (half of what is left when both are)
+      size_t unknown = (size_t)(last - first);
+      size_t left_split = (num_l == 0) ? ((num_r == 0) ? unknown / 2 : unknown) : 0;
+      size_t right_split = (num_r == 0) ? unknown - left_split : 0;
+      if (left_split >= ARRAY_PDQ_BLOCK_SIZE) {
+        num_l = array_pdq_offsets_left(first, ARRAY_PDQ_BLOCK_SIZE, pivot, offsets_l);
+        first += ARRAY_PDQ_BLOCK_SIZE;
+        ARRAY_STATS_COMPARE(ARRAY_PDQ_BLOCK_SIZE);
+      } else if (left_split > 0) {
+        num_l = array_pdq_offsets_left(first, left_split, pivot, offsets_l);
+        first += left_split;
+        ARRAY_STATS_COMPARE(left_split);
+      }
+      if (right_split >= ARRAY_PDQ_BLOCK_SIZE) {
+        num_r = array_pdq_offsets_right(last, ARRAY_PDQ_BLOCK_SIZE, pivot, offsets_r);
+        last -= ARRAY_PDQ_BLOCK_SIZE;
+        ARRAY_STATS_COMPARE(ARRAY_PDQ_BLOCK_SIZE);
+      } else if (right_split > 0) {
+        num_r = array_pdq_offsets_right(last, right_split, pivot, offsets_r);
+        last -= right_split;
+        ARRAY_STATS_COMPARE(right_split);
+      }
+
+      size_t num = (num_l < num_r) ? num_l : num_r;
+      array_pdq_swap_offsets(base_l, base_r, offsets_l + start_l, offsets_r + start_r, num, num_l == num_r);
+      num_l -= num;
+      num_r -= num;
+      start_l += num;
+      start_r += num;
+      if (num_l == 0) {
+        start_l = 0;
+        base_l = first;
+      }
+      if (num_r == 0) {
+        start_r = 0;
+        base_r = last;
+      }
+    }
+
+    // one side still has misplaced elements, they go to the end of the other side
+    if (num_l > 0) {
+      while (num_l-- > 0) array_exchange(base_l + offsets_l[start_l + num_l], --last);
+      first = last;
+    }
+    if (num_r > 0) {
+      while (num_r-- > 0) array_exchange(base_r - offsets_r[start_r + num_r], first++);
+    }
+  }
+
+  int *pivot_pos = first - 1;
+  *begin = *pivot_pos;
+  *pivot_pos = pivot;
+  return pivot_pos;
+}
+
+/*
+ * Partition [begin, end) with the elements equal to the pivot at begin on its left, returns the place of the
+ * last of them: used when the pivot equals the one of the parent partition, so that the range is done
+ */
+static int *array_pdq_partition_left(int *begin, int *end) {
+  int pivot = *begin;
+  int *first = begin;
+  int *last = end;
+  while (pivot < *--last) {
+  }
+  if (last + 1 == end) {
+    while (first < last && !(pivot < *++first)) {
+    }
+  } else {
+    while (!(pivot < *++first)) {
+    }
+  }
+  while (first < last) {
+    array_exchange(first, last);
+    while (pivot < *--last) {
+    }
+    while (!(pivot < *++first)) {
+    }
+  }
+  ARRAY_STATS_COMPARE((uint64_t)(end - begin));
+  *begin = *last;
+  *last = pivot;
+  return last;
+}
+
+static void array_pdq_loop(int *begin, int *end, unsigned bad_allowed, bool leftmost) {
+  for (;;) {
+    size_t size = (size_t)(end - begin);
+    if (size < ARRAY_PDQ_INSERTION_SORT_THRESHOLD) {
+      if (leftmost) {
+        array_insertion_sort_range(begin, 0, (ptrdiff_t)size - 1);
+      } else {
+        array_unguarded_insertion_sort(begin, size);
+      }
+      return;
+    }
+
+    // median of three (ninther for large ranges) moved to begin
+    size_t half = size / 2;
+    if (size > ARRAY_NINTHER_THRESHOLD) {
+      array_sort3(begin, begin + half, end - 1);
+      array_sort3(begin + 1, begin + (half - 1), end - 2);
+      array_sort3(begin + 2, begin + (half + 1), end - 3);
+      array_sort3(begin + (half - 1), begin + half, begin + (half + 1));
+      array_exchange(begin, begin + half);
+    } else {
+      array_sort3(begin + half, begin, end - 1);
+    }
+
+    // the element before the range is the pivot of a parent partition, none here is smaller than it:
+    // if this pivot equals it, the range holds many equal elements that need no further sorting
+    if (!leftmost && !(begin[-1] < *begin)) {
+      begin = array_pdq_partition_left(begin, end) + 1;
+      continue;
+    }
+
+    bool already_partitioned;
+    int *pivot = array_pdq_partition_right(begin, end, &already_partitioned);
+    size_t l_size = (size_t)(pivot - begin);
+    size_t r_size = (size_t)(end - (pivot + 1));
+
+    if (l_size < size / 8 || r_size < size / 8) {
+      if (--bad_allowed == 0) {
+        array_heap_sort_range(begin, size, 2);
+        return;
+      }
+      // break the pattern that made the pivot bad by moving a few elements around
+      if (l_size >= ARRAY_PDQ_INSERTION_SORT_THRESHOLD) {
+        array_exchange(begin, begin + l_size / 4);
+        array_exchange(pivot - 1, pivot - l_size / 4);
+        if (l_size > ARRAY_NINTHER_THRESHOLD) {
+          array_exchange(begin + 1, begin + (l_size / 4 + 1));
+          array_exchange(begin + 2, begin + (l_size / 4 + 2));
+          array_exchange(pivot - 2, pivot - (l_size / 4 + 1));
+          array_exchange(pivot - 3, pivot - (l_size / 4 + 2));
+        }
+      }
+      if (r_size >= ARRAY_PDQ_INSERTION_SORT_THRESHOLD) {
+        array_exchange(pivot + 1, pivot + (1 + r_size / 4));
+        array_exchange(end - 1, end - r_size / 4);
+        if (r_size > ARRAY_NINTHER_THRESHOLD) {
+          array_exchange(pivot + 2, pivot + (2 + r_size / 4));
+          array_exchange(pivot + 3, pivot + (3 + r_size / 4));
+          array_exchange(end - 2, end - (1 + r_size / 4));
+          array_exchange(end - 3, end - (2 + r_size / 4));
+        }
+      }
+    } else if (already_partitioned
+        && array_partial_insertion_sort(begin, l_size)
+        && array_partial_insertion_sort(pivot + 1, r_size)) {
+      // the pivot guessed right and both sides were (almost) sorted
+      return;
+    }
+
+    array_pdq_loop(begin, pivot, bad_allowed, leftmost);
+    begin = pivot + 1;
+    leftmost = false;
+  }
+}
+
+void array_pdq_sort(struct array *self) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SORT);
+  array_contiguous(self);
+  if (self->size > 1) {
+    array_pdq_loop(self->data, self->data + self->size, array_log2(self->size), true);
+  }
+  self->sorted = true;
+}
+
+/*
+ * Natural runs shorter than this are extended with a binary insertion sort (the actual
+ * minimum is between half of it and it, chosen so that the number of runs is a power of two)
+ */
+#define ARRAY_STABLE_SORT_MIN_RUN 64
+
+/*
+ * A merge switches to galloping after this many elements in a row came from the same run
+ */
+#define ARRAY_STABLE_SORT_MIN_GALLOP 7
+
+/*
+ * The run lengths grow at least like Fibonacci numbers on the stack, so this is enough for any size_t
+ */
+#define ARRAY_STABLE_SORT_MAX_RUNS 85
+
+struct array_stable_sort {
+  int *data;
+  int *scratch;
+  size_t min_gallop;
+  size_t count;
+  struct {
+    size_t base;
+    size_t size;
+  } runs[ARRAY_STABLE_SORT_MAX_RUNS];
+};
+
+static size_t array_min_run(size_t n) {
+  size_t r = 0;
+  while (n >= ARRAY_STABLE_SORT_MIN_RUN) {
+    r |= n & 1;
+    n >>= 1;
+  }
+  return n + r;
+}
+
+static void array_reverse_range(int *data, size_t n) {
+  for (size_t i = 0, j = n - 1; i < j; ++i, --j) {
+    int tmp = data[i];
+    data[i] = data[j];
+    data[j] = tmp;
+  }
+}
+
+/*
+ * Get the length of the run at the start of the range: non-decreasing, or strictly
+ * decreasing and then reversed (strictly so that equal elements keep their order)
+ */
+static size_t array_count_run(int *data, size_t n) {
+  if (n < 2) return n;
+  size_t i = 2;
+  if (data[1] < data[0]) {
+    while (i < n && data[i] < data[i - 1]) ++i;
+    array_reverse_range(data, i);
+  } else {
+    while (i < n && data[i] >= data[i - 1]) ++i;
+  }
+  return i;
+}
+
+/*
+ * Sort the n first elements knowing that the sorted ones come first, each new one goes after its equals
+ */
+static void array_binary_insertion_sort(int *data, size_t n, size_t sorted) {
+  for (size_t i = sorted; i < n; ++i) {
+    int value = data[i];
+    size_t position = array_bound(data, i, value, true);
+    memmove(data + position + 1, data + position, (i - position) * sizeof(int));
+    data[position] = value;
+  }
+}
+
+/*
+ * Merge the adjacent runs a and b from the left, a (the smaller one) is moved to the scratch buffer first.
+ * Once a run wins often enough, whole blocks are found by galloping and moved at once
+ */
+static void array_merge_low(struct array_stable_sort *sort, int *a, size_t na, int *b, size_t nb) {
+  int *x = sort->scratch;
+  int *x_end = x + na;
+  int *y = b;
+  int *y_end = b + nb;
+  int *dst = a;
+  memcpy(x, a, na * sizeof(int));
+
+  while (x < x_end && y < y_end) {
+    size_t x_wins = 0;
+    size_t y_wins = 0;
+    while (x < x_end && y < y_end && x_wins < sort->min_gallop && y_wins < sort->min_gallop) {
+      if (*y < *x) {
+        *dst++ = *y++;
+        ++y_wins;
+        x_wins = 0;
+      } else {
+        *dst++ = *x++;
+        ++x_wins;
+        y_wins = 0;
+      }
+    }
+    while (x < x_end && y < y_end) {
+      // elements of a equal to the head of b go first
+      size_t kx = array_gallop(x, (size_t)(x_end - x), *y, true);
+      memcpy(dst, x, kx * sizeof(int));
+      dst += kx;
+      x += kx;
+      if (x == x_end) break;
+      size_t ky = array_gallop(y, (size_t)(y_end - y), *x, false);
+      memmove(dst, y, ky * sizeof(int));
+      dst += ky;
+      y += ky;
+      if (sort->min_gallop > 1) --sort->min_gallop;
+      if (kx < ARRAY_STABLE_SORT_MIN_GALLOP && ky < ARRAY_STABLE_SORT_MIN_GALLOP) {
+        sort->min_gallop += 2;
+        break;
+      }
+    }
+  }
+  // what is left of b is already in place
+  memcpy(dst, x, (size_t)(x_end - x) * sizeof(int));
+}
+
+/*
+ * Same as array_merge_low from the right, b (the smaller one) is moved to the scratch buffer
+ */
+static void array_merge_high(struct array_stable_sort *sort, int *a, size_t na, int *b, size_t nb) {
+  int *x_begin = a;
+  int *x = a + na;
+  int *y_begin = sort->scratch;
+  int *y = y_begin + nb;
+  int *dst = b + nb;
+  memcpy(y_begin, b, nb * sizeof(int));
+
+  while (x > x_begin && y > y_begin) {
+    size_t x_wins = 0;
+    size_t y_wins = 0;
+    while (x > x_begin && y > y_begin && x_wins < sort->min_gallop && y_wins < sort->min_gallop) {
+      if (y[-1] < x[-1]) {
+        *--dst = *--x;
+        ++x_wins;
+        y_wins = 0;
+      } else {
+        *--dst = *--y;
+        ++y_wins;
+        x_wins = 0;
+      }
+    }
+    while (x > x_begin && y > y_begin) {
+      // elements of a greater than the tail of b go last
+      size_t kx = (size_t)(x - x_begin) - array_gallop_back(x_begin, (size_t)(x - x_begin), y[-1], true);
+      dst -= kx;
+      x -= kx;
+      memmove(dst, x, kx * sizeof(int));
+      if (x == x_begin) break;
+      size_t ky = (size_t)(y - y_begin) - array_gallop_back(y_begin, (size_t)(y - y_begin), x[-1], false);
+      dst -= ky;
+      y -= ky;
+      memcpy(dst, y, ky * sizeof(int));
+      if (sort->min_gallop > 1) --sort->min_gallop;
+      if (kx < ARRAY_STABLE_SORT_MIN_GALLOP && ky < ARRAY_STABLE_SORT_MIN_GALLOP) {
+        sort->min_gallop += 2;
+        break;
+      }
+    }
+  }
+  // what is left of a is already in place
+  memcpy(x_begin, y_begin, (size_t)(y - y_begin) * sizeof(int));
+}
+
+/*
+ * Merge the runs i and i + 1 of the stack
+ */
+static void array_merge_runs(struct array_stable_sort *sort, size_t i) {
+  int *a = sort->data + sort->runs[i].base;
+  size_t na = sort->runs[i].size;
+  int *b = sort->data + sort->runs[i + 1].base;
+  size_t nb = sort->runs[i + 1].size;
+
+  sort->runs[i].size += nb;
+  if (i + 2 < sort->count) sort->runs[i + 1] = sort->runs[i + 2];
+  --sort->count;
+
+  // the start of a and the end of b may already be in place
+  size_t skip = array_gallop(a, na, b[0], true);
+  a += skip;
+  na -= skip;
+  if (na == 0) return;
+  nb = array_gallop_back(b, nb, a[na - 1], false);
+  if (nb == 0) return;
+
+  if (na <= nb) {
+    array_merge_low(sort, a, na, b, nb);
+  } else {
+    array_merge_high(sort, a, na, b, nb);
+  }
+}
+
+/*
+ * Merge the top runs until their sizes decrease fast enough, so that the merges stay balanced
+ * (the check goes three runs deep, the two-run check of the original timsort misses some cases)
+ */
+static void array_collapse_runs(struct array_stable_sort *sort) {
+  while (sort->count > 1) {
+    size_t n = sort->count - 2;
+    if ((n > 0 && sort->runs[n - 1].size <= sort->runs[n].size + sort->runs[n + 1].size)
+        || (n > 1 && sort->runs[n - 2].size <= sort->runs[n - 1].size + sort->runs[n].size)) {
+      if (sort->runs[n - 1].size < sort->runs[n + 1].size) --n;
+    } else if (sort->runs[n].size > sort->runs[n + 1].size) {
+      break;
+    }
+    array_merge_runs(sort, n);
+  }
+}
+
+void array_stable_sort(struct array *self) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SORT);
+  array_contiguous(self);
+  size_t n = self->size;
+  if (array_is_sorted(self)) return;
+  // the runs are sorted and merged in the buffer directly, nothing below clears it
+  self->sorted = true;
+  if (n < ARRAY_STABLE_SORT_MIN_RUN) {
+    array_binary_insertion_sort(self->data, n, array_count_run(self->data, n));
+    return;
+  }
+  struct array_stable_sort sort;
+  sort.data = self->data;
+  sort.scratch = array_scratch(self, n / 2);
+  sort.min_gallop = ARRAY_STABLE_SORT_MIN_GALLOP;
+  sort.count = 0;
+  if (sort.scratch == NULL) {
+    // equal ints cannot be told apart, so an unstable sort gives the same result
+    array_quick_sort(self);
+    return;
+  }
+
+  size_t min_run = array_min_run(n);
+  size_t base = 0;
+  while (base < n) {
+    size_t remaining = n - base;
+    size_t run = array_count_run(self->data + base, remaining);
+    if (run < min_run) {
+      size_t extended = (remaining < min_run) ? remaining : min_run;
+      array_binary_insertion_sort(self->data + base, extended, run);
+      run = extended;
+    }
+    sort.runs[sort.count].base = base;
+    sort.runs[sort.count].size = run;
+    ++sort.count;
+    array_collapse_runs(&sort);
+    base += run;
+  }
+  while (sort.count > 1) {
+    size_t i = sort.count - 2;
+    if (i > 0 && sort.runs[i - 1].size < sort.runs[i + 1].size) --i;
+    array_merge_runs(&sort, i);
+  }
+}
+
+/*
+ * Below this size the radix sort costs more than a comparison sort
+ */
+#define ARRAY_RADIX_SORT_THRESHOLD 256
+
+#define ARRAY_RADIX_BITS 8
+#define ARRAY_RADIX_BUCKETS (1 << ARRAY_RADIX_BITS)
+#define ARRAY_RADIX_PASSES (32 / ARRAY_RADIX_BITS)
+
+/*
+ * Flip the sign bit so that negative values come first when compared as unsigned
+ */
+static inline uint32_t array_radix_key(int value) {
+  return (uint32_t)value ^ UINT32_C(0x80000000);
+}
+
+void array_radix_sort(struct array *self) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SORT);
+  array_contiguous(self);
+  size_t n = self->size;
+  if (n < ARRAY_RADIX_SORT_THRESHOLD) {
+    array_quick_sort(self);
+    return;
+  }
+  int *scratch = array_scratch(self, n);
+  if (scratch == NULL) {
+    array_quick_sort(self);
+    return;
+  }
+
+  size_t histograms[ARRAY_RADIX_PASSES][ARRAY_RADIX_BUCKETS] = { { 0 } };
+  for (size_t i = 0; i < n; ++i) {
+    uint32_t key = array_radix_key(self->data[i]);
+    for (unsigned pass = 0; pass < ARRAY_RADIX_PASSES; ++pass) {
+      ++histograms[pass][(key >> (pass * ARRAY_RADIX_BITS)) & (ARRAY_RADIX_BUCKETS - 1)];
+    }
+  }
+
+  int *src = self->data;
+  int *dst = scratch;
+  for (unsigned pass = 0; pass < ARRAY_RADIX_PASSES; ++pass) {
+    size_t *histogram = histograms[pass];
+    unsigned shift = pass * ARRAY_RADIX_BITS;
+
+    // all the elements share this digit: the pass would not move anything
+    if (histogram[(array_radix_key(src[0]) >> shift) & (ARRAY_RADIX_BUCKETS - 1)] == n) continue;
+
+    size_t offset = 0;
+    for (size_t b = 0; b < ARRAY_RADIX_BUCKETS; ++b) {
+      size_t count = histogram[b];
+      histogram[b] = offset;
+      offset += count;
+    }
+    for (size_t i = 0; i < n; ++i) {
+      dst[histogram[(array_radix_key(src[i]) >> shift) & (ARRAY_RADIX_BUCKETS - 1)]++] = src[i];
+    }
+
+    int *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+
+  if (src != self->data) {
+    memcpy(self->data, src, n * sizeof(int));
+  }
+  self->sorted = true;
+}
+
+/*
+ * Below this size the threads cost more than they bring
+ */
+#define ARRAY_PARALLEL_SORT_THRESHOLD 100000
+
+/*
+ * Number of samples taken per thread to choose the splitters
+ */
+#define ARRAY_PARALLEL_SORT_OVERSAMPLING 64
+
+struct array_parallel_sort {
+  int *data;
+  int *scratch;
+  size_t size;
+  unsigned threads;        // number of chunks and of buckets
+  const int *splitters;    // threads - 1 values
+  size_t *counts;          // counts[t * threads + b]: elements of chunk t going to bucket b
+  unsigned workers;        // threads running the phases (the calling one included), 0 to give up
+  pthread_mutex_t start;   // held while the workers are created
+  pthread_barrier_t phase; // separates the counts, the scatter and the bucket sorts
+};
+
+/*
+ * A thread of the sort, it handles the chunks and the buckets index, index + workers...
+ */
+struct array_parallel_worker {
+  struct array_parallel_sort *sort;
+  unsigned index;
+  uint64_t comparisons; // counted by the thread, added to the statistics of the sort by the calling thread
+  uint64_t swaps;
+};
+
+static void array_parallel_chunk(const struct array_parallel_sort *sort, unsigned t, size_t *first, size_t *last) {
+  *first = sort->size * t / sort->threads;
+  *last = sort->size * (t + 1) / sort->threads;
+}
+
+static void array_parallel_count(struct array_parallel_sort *sort, unsigned t) {
+  size_t *counts = sort->counts + (size_t)t * sort->threads;
+  size_t first, last;
+  array_parallel_chunk(sort, t, &first, &last);
+  for (size_t i = first; i < last; ++i) {
+    ++counts[array_bound(sort->splitters, sort->threads - 1, sort->data[i], true)];
+  }
+}
+
+static void array_parallel_scatter(struct array_parallel_sort *sort, unsigned t) {
+  unsigned threads = sort->threads;
+  size_t offsets[threads];
+  size_t offset = 0;
+  for (unsigned b = 0; b < threads; ++b) {
+    for (unsigned c = 0; c < threads; ++c) {
+      if (c == t) offsets[b] = offset;
+      offset += sort->counts[(size_t)c * threads + b];
+    }
+  }
+  size_t first, last;
+  array_parallel_chunk(sort, t, &first, &last);
+  for (size_t i = first; i < last; ++i) {
+    int value = sort->data[i];
+    sort->scratch[offsets[array_bound(sort->splitters, threads - 1, value, true)]++] = value;
+  }
+}
+
+static void array_parallel_sort_bucket(struct array_parallel_sort *sort, unsigned b) {
+  unsigned threads = sort->threads;
+  size_t first = 0;
+  for (size_t k = 0; k < (size_t)b * threads; ++k) {
+    first += sort->counts[(k % threads) * threads + k / threads];
+  }
+  size_t n = 0;
+  for (unsigned t = 0; t < threads; ++t) {
+    n += sort->counts[(size_t)t * threads + b];
+  }
+  int *bucket = sort->scratch + first;
+  if (n > 1) array_intro_sort(bucket, 0, (ptrdiff_t)n - 1, 2 * array_log2(n));
+  memcpy(sort->data + first, bucket, n * sizeof(int));
+}
+
+/*
+ * Run the three phases on the chunks and buckets of the worker, the barrier waits for all
+ * the counts before the scatter, and for the whole scatter before the bucket sorts
+ */
+static void *array_parallel_work(void *arg) {
+  struct array_parallel_worker *worker = arg;
+  struct array_parallel_sort *sort = worker->sort;
+  // once the lock is free all the workers are created and the barrier is ready
+  pthread_mutex_lock(&sort->start);
+  pthread_mutex_unlock(&sort->start);
+  unsigned threads = sort->threads;
+  unsigned workers = sort->workers;
+  if (workers == 0) return NULL;
+  for (unsigned t = worker->index; t < threads; t += workers) {
+    array_parallel_count(sort, t);
+  }
+  pthread_barrier_wait(&sort->phase);
+  for (unsigned t = worker->index; t < threads; t += workers) {
+    array_parallel_scatter(sort, t);
+  }
+  pthread_barrier_wait(&sort->phase);
+  for (unsigned b = worker->index; b < threads; b += workers) {
+    array_parallel_sort_bucket(sort, b);
+  }
+  ARRAY_STATS_EXPORT(worker->comparisons, worker->swaps);
+  return NULL;
+}
+
+void array_parallel_sort(struct array *self, unsigned threads) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SORT);
+  array_contiguous(self);
+  size_t n = self->size;
+  if (threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (online > 0) ? (unsigned)online : 1;
+  }
+  if (threads > n / ARRAY_PARALLEL_SORT_THRESHOLD) {
+    threads = (unsigned)(n / ARRAY_PARALLEL_SORT_THRESHOLD);
+  }
+  if (threads <= 1) {
+    array_quick_sort(self);
+    return;
+  }
+
+  int *scratch = array_scratch(self, n);
+  size_t samples_size = (size_t)threads * ARRAY_PARALLEL_SORT_OVERSAMPLING;
+  int *samples = malloc(samples_size * sizeof(int));
+  size_t *counts = calloc((size_t)threads * threads, sizeof(size_t));
+  struct array_parallel_worker *pool = calloc(threads, sizeof(struct array_parallel_worker));
+  if (scratch == NULL || samples == NULL || counts == NULL || pool == NULL) {
+    free(samples);
+    free(counts);
+    free(pool);
+    array_quick_sort(self);
+    return;
+  }
+
+  // sample sort: the sorted samples give threads - 1 splitters that cut the values in buckets of similar sizes
+  for (size_t i = 0; i < samples_size; ++i) {
+    samples[i] = self->data[i * (n / samples_size)];
+  }
+  array_intro_sort(samples, 0, (ptrdiff_t)samples_size - 1, 2 * array_log2(samples_size));
+  for (unsigned t = 1; t < threads; ++t) {
+    samples[t - 1] = samples[(size_t)t * ARRAY_PARALLEL_SORT_OVERSAMPLING];
+  }
+
+  struct array_parallel_sort sort = {
+    .data = self->data,
+    .scratch = scratch,
+    .size = n,
+    .threads = threads,
+    .splitters = samples,
+    .counts = counts,
+    .start = PTHREAD_MUTEX_INITIALIZER,
+  };
+
+  // one pool for the three phases, the calling thread is worker 0 and runs the jobs of the workers that could not be created
+  pthread_t handles[threads];
+  unsigned workers = 1;
+  pthread_mutex_lock(&sort.start);
+  for (unsigned t = 1; t < threads; ++t) {
+    pool[workers] = (struct array_parallel_worker){ .sort = &sort, .index = workers };
+    if (pthread_create(&handles[workers], NULL, array_parallel_work, &pool[workers]) == 0) ++workers;
+  }
+  bool synchronized = pthread_barrier_init(&sort.phase, NULL, workers) == 0;
+  sort.workers = synchronized ? workers : 0;
+  pthread_mutex_unlock(&sort.start);
+  pool[0] = (struct array_parallel_worker){ .sort = &sort, .index = 0 };
+  array_parallel_work(&pool[0]);
+  for (unsigned w = 1; w < workers; ++w) {
+    pthread_join(handles[w], NULL);
+    ARRAY_STATS_IMPORT(pool[w].comparisons, pool[w].swaps);
+  }
+  if (synchronized) pthread_barrier_destroy(&sort.phase);
+
+  free(samples);
+  free(counts);
+  free(pool);
+  if (!synchronized) {
+    array_quick_sort(self);
+    return;
+  }
+  self->sorted = true;
+}
+
+/*
+ * d-ary heap: the children of i are d*i+1 .. d*i+d, they are contiguous so one
+ * sift-down step reads 16 (4-ary) or 32 (8-ary) consecutive bytes, and the tree is
+ * two or three times shallower than the binary one. The groups of siblings are not
+ * aligned (the heap is the buffer of the array, the root is its first element), so
+ * a group can straddle two cache lines
+ */
+
+static bool array_heap_binary(const struct array *self) {
+  return self->heap_arity <= 2;
+}
+
+static unsigned array_heap_degree(const struct array *self) {
+  return array_heap_binary(self) ? 2 : self->heap_arity;
+}
+
+/*
+ * Check any arity through array_slot, for the elements that are not contiguous
+ */
+static bool array_is_heap_slots(const struct array *self) {
+  unsigned d = array_heap_degree(self);
+  for (size_t k = 1; k < self->size; ++k) {
+    if (*array_slot(self, (k - 1) / d) < *array_slot(self, k)) return false;
+  }
+  return true;
+}
+
+void array_set_heap_arity(struct array *self, unsigned arity) {
+  self->heap_arity = (arity >= 8) ? 8 : (arity >= 4) ? 4 : 2;
+}
+
+void array_heap_sort(struct array *self){
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_SORT);
+  array_contiguous(self);
+  array_heap_sort_range(self->data, self->size, array_heap_degree(self));
+  self->sorted = true;
+}
+
+bool array_is_heap(const struct array *self) {
+  if (!array_is_contiguous(self)) return array_is_heap_slots(self);
+  if (!array_heap_binary(self)) return array_is_heap_range(self->data, self->size, self->heap_arity);
+  return array_kernels->is_heap(self->data, self->size);
+}
+
+void array_heap_add(struct array *self, int value) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_COUNT);
+  array_contiguous(self);
+  size_t i = self->size;
+  array_push_back(self,value);
+  array_sift_up(self->data, i, array_heap_degree(self));
+  self->sorted = false;
+}
+
+int array_heap_top(const struct array *self) {
+  return *array_slot(self, 0);
+}
+
+void array_heap_remove_top(struct array *self) {
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_COUNT);
+  array_contiguous(self);
+  size_t n = self->size;
+  self->data[0] = self->data[n-1];
+  self->sorted = false;
+  array_pop_back(self);
+  if (array_heap_binary(self)) {
+    array_sift_down_floyd(self->data, n - 1, 0);
+  } else {
+    array_sift_down_dary(self->data, n - 1, 0, self->heap_arity);
+  }
+}
+
+/*
+ * Sift-down of a binary min-heap, used to keep the k largest values seen so far
+ */
+static void array_sift_down_min(int *data, size_t n, size_t i) {
+  int value = data[i];
+  size_t child;
+  while ((child = 2 * i + 1) < n) {
+    ARRAY_STATS_COMPARE(2);
+    if (child + 1 < n && data[child + 1] < data[child]) ++child;
+    if (data[child] >= value) break;
+    data[i] = data[child];
+    i = child;
+  }
+  data[i] = value;
+}
+
+bool array_top_k(const struct array *self, size_t k, struct array *out) {
+  if (out == self) return false;
+  ARRAY_STATS_SCOPE(self, ARRAY_STATS_COUNT);
+  if (k > self->size) k = self->size;
+  array_clear(out);
+  if (k == 0) return true;
+  const int *data;
+  if (!array_reserve(out, k) || !array_view(self, &data)) return false;
+  int *heap = out->data;
+  memcpy(heap, data, k * sizeof(int));
+  for (size_t i = k / 2; i-- > 0;) array_sift_down_min(heap, k, i);
+
+  // most values are smaller than the k-th largest one and cost a single comparison
+  for (size_t i = k; i < self->size; ++i) {
+    if (data[i] > heap[0]) {
+      heap[0] = data[i];
+      array_sift_down_min(heap, k, 0);
+    }
+  }
+  array_release_view(self, data);
+
+  // moving the minimum to the end each time leaves the values in decreasing order
+  for (size_t n = k; n > 1; --n) {
+    int top = heap[0];
+    heap[0] = heap[n - 1];
+    heap[n - 1] = top;
+    array_sift_down_min(heap, n - 1, 0);
+  }
+  out->size = k;
+  return true;
+}
+
+/*
+ * Binary format: a 32-byte header followed by the payload.
+ *
+ *   0  magic "DARR"
+ *   4  version
+ *   5  width of an element in bytes
+ *   6  endianness of the raw payload (0 little, 1 big)
+ *   7  flags (ARRAY_FORMAT_SORTED, ARRAY_FORMAT_DELTA_VARINT)
+ *   8  number of elements (u64)
+ *  16  size of the payload in bytes (u64)
+ *  24  Adler-32 of the payload (u32)
+ *  28  reserved
+ *
+ * The header fields are little-endian. The raw payload is the elements as they are in
+ * memory. The delta-varint payload (sorted arrays only) is the first element zigzag
+ * encoded then the differences between consecutive elements, as LEB128 varints.
+ */
+
+#define ARRAY_FORMAT_VERSION 1
+#define ARRAY_FORMAT_HEADER_SIZE 32
+#define ARRAY_FORMAT_SORTED 0x01
+#define ARRAY_FORMAT_DELTA_VARINT 0x02
+
+/*
+ * Size of the blocks read or written at once
+ */
+#define ARRAY_IO_CHUNK (1 << 16)
+
+#define ARRAY_ADLER_MOD 65521
+#define ARRAY_ADLER_NMAX 5552 // largest block before the sums can overflow
+
+static uint32_t array_adler32(uint32_t adler, const unsigned char *bytes, size_t n) {
+  uint32_t a = adler & 0xFFFF;
+  uint32_t b = adler >> 16;
+  while (n > 0) {
+    size_t block = (n < ARRAY_ADLER_NMAX) ? n : ARRAY_ADLER_NMAX;
+    n -= block;
+    while (block-- > 0) {
+      a += *bytes++;
+      b += a;
+    }
+    a %= ARRAY_ADLER_MOD;
+    b %= ARRAY_ADLER_MOD;
+  }
+  return (b << 16) | a;
+}
+
+static bool array_write_all(int fd, const void *buf, size_t n) {
+  const char *bytes = buf;
+  while (n > 0) {
+    ssize_t written = write(fd, bytes, (n < ARRAY_IO_CHUNK) ? n : ARRAY_IO_CHUNK);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    bytes += written;
+    n -= (size_t)written;
+  }
+  return true;
+}
+
+/*
+ * Read up to n bytes, stops early only at the end of the stream, returns the number of bytes read or -1
+ */
+static ssize_t array_read_all(int fd, void *buf, size_t n) {
+  char *bytes = buf;
+  size_t total = 0;
+  while (total < n) {
+    ssize_t count = read(fd, bytes + total, n - total);
+    if (count < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (count == 0) break;
+    total += (size_t)count;
+  }
+  return (ssize_t)total;
+}
+
+static void array_store_u64(unsigned char *bytes, uint64_t value) {
+  for (unsigned i = 0; i < 8; ++i) {
+    bytes[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+static uint64_t array_load_u64(const unsigned char *bytes) {
+  uint64_t value = 0;
+  for (unsigned i = 0; i < 8; ++i) {
+    value |= (uint64_t)bytes[i] << (8 * i);
+  }
+  return value;
+}
+
+static void array_store_u32(unsigned char *bytes, uint32_t value) {
+  for (unsigned i = 0; i < 4; ++i) {
+    bytes[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+static uint32_t array_load_u32(const unsigned char *bytes) {
+  uint32_t value = 0;
+  for (unsigned i = 0; i < 4; ++i) {
+    value |= (uint32_t)bytes[i] << (8 * i);
+  }
+  return value;
+}
+
+static bool array_big_endian(void) {
+  return __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+}
+
+static size_t array_varint_size(uint32_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+static size_t array_varint_encode(unsigned char *bytes, uint32_t value) {
+  size_t size = 0;
+  while (value >= 0x80) {
+    bytes[size++] = (unsigned char)(value | 0x80);
+    value >>= 7;
+  }
+  bytes[size++] = (unsigned char)value;
+  return size;
+}
+
+static uint32_t array_zigzag(int value) {
+  return ((uint32_t)value << 1) ^ (uint32_t)-(int32_t)((uint32_t)value >> 31);
+}
+
+static int array_unzigzag(uint32_t value) {
+  return (int)((value >> 1) ^ (uint32_t)-(int32_t)(value & 1));
+}
+
+/*
+ * Value of the k-th varint of the delta encoding (the difference wraps around, it is always positive for a sorted array)
+ */
+static uint32_t array_delta(const int *data, size_t k) {
+  if (k == 0) return array_zigzag(data[0]);
+  return (uint32_t)data[k] - (uint32_t)data[k - 1];
+}
+
+static bool array_save_delta_varint(const int *data, size_t size, int fd, unsigned char *header) {
+  uint64_t payload_size = 0;
+  for (size_t k = 0; k < size; ++k) {
+    payload_size += array_varint_size(array_delta(data, k));
+  }
+
+  unsigned char *chunk = malloc(ARRAY_IO_CHUNK);
+  if (chunk == NULL) return false;
+
+  // the checksum needs the whole payload before the header is written: encode it twice rather than keeping it
+  uint32_t checksum = 1;
+  size_t used = 0;
+  for (size_t k = 0; k < size; ++k) {
+    used += array_varint_encode(chunk + used, array_delta(data, k));
+    if (used > ARRAY_IO_CHUNK - 5 || k + 1 == size) {
+      checksum = array_adler32(checksum, chunk, used);
+      used = 0;
+    }
+  }
+
+  array_store_u64(header + 16, payload_size);
+  array_store_u32(header + 24, checksum);
+  bool ok = array_write_all(fd, header, ARRAY_FORMAT_HEADER_SIZE);
+  for (size_t k = 0; ok && k < size; ++k) {
+    used += array_varint_encode(chunk + used, array_delta(data, k));
+    if (used > ARRAY_IO_CHUNK - 5 || k + 1 == size) {
+      ok = array_write_all(fd, chunk, used);
+      used = 0;
+    }
+  }
+  free(chunk);
+  return ok;
+}
+
+bool array_save(const struct array *self, int fd, unsigned flags) {
+  unsigned char header[ARRAY_FORMAT_HEADER_SIZE] = { 'D', 'A', 'R', 'R', ARRAY_FORMAT_VERSION, sizeof(int) };
+  header[6] = array_big_endian() ? 1 : 0;
+  bool sorted = array_is_sorted(self);
+  header[7] = sorted ? ARRAY_FORMAT_SORTED : 0;
+  array_store_u64(header + 8, self->size);
+  const int *data;
+  if (!array_view(self, &data)) return false;
+
+  bool ok;
+  if (sorted && (flags & ARRAY_SAVE_DELTA_VARINT) != 0) {
+    header[7] |= ARRAY_FORMAT_DELTA_VARINT;
+    ok = array_save_delta_varint(data, self->size, fd, header);
+  } else {
+    size_t payload_size = self->size * sizeof(int);
+    array_store_u64(header + 16, payload_size);
+    array_store_u32(header + 24, array_adler32(1, (const unsigned char *)data, payload_size));
+    ok = array_write_all(fd, header, ARRAY_FORMAT_HEADER_SIZE)
+      && array_write_all(fd, data, payload_size);
+  }
+  array_release_view(self, data);
+  return ok;
+}
+
+static bool array_load_raw(struct array *self, int fd, uint64_t payload_size, uint32_t checksum, bool swap) {
+  uint32_t adler = 1;
+  unsigned char *bytes = (unsigned char *)self->data;
+  size_t total = 0;
+  while (total < payload_size) {
+    size_t n = (payload_size - total < ARRAY_IO_CHUNK) ? (size_t)(payload_size - total) : ARRAY_IO_CHUNK;
+    if (array_read_all(fd, bytes + total, n) != (ssize_t)n) return false;
+    adler = array_adler32(adler, bytes + total, n);
+    total += n;
+  }
+  if (adler != checksum) return false;
+  if (swap) {
+    for (size_t i = 0; i < payload_size / sizeof(int); ++i) {
+      self->data[i] = (int)__builtin_bswap32((uint32_t)self->data[i]);
+    }
+  }
+  return true;
+}
+
+static bool array_load_delta_varint(struct array *self, int fd, uint64_t size, uint64_t payload_size, uint32_t checksum) {
+  unsigned char *chunk = malloc(ARRAY_IO_CHUNK);
+  if (chunk == NULL) return false;
+
+  uint32_t adler = 1;
+  uint32_t value = 0;
+  unsigned shift = 0;
+  uint32_t previous = 0;
+  size_t count = 0;
+  bool ok = true;
+  uint64_t total = 0;
+  while (ok && total < payload_size) {
+    size_t n = (payload_size - total < ARRAY_IO_CHUNK) ? (size_t)(payload_size - total) : ARRAY_IO_CHUNK;
+    if (array_read_all(fd, chunk, n) != (ssize_t)n) {
+      ok = false;
+      break;
+    }
+    adler = array_adler32(adler, chunk, n);
+    total += n;
+    // a varint can straddle two chunks, value and shift carry it over
+    for (size_t i = 0; i < n; ++i) {
+      value |= (uint32_t)(chunk[i] & 0x7F) << shift;
+      if (chunk[i] & 0x80) {
+        shift += 7;
+        if (shift >= 35) {
+          ok = false;
+          break;
+        }
+        continue;
+      }
+      if (count == size) {
+        ok = false;
+        break;
+      }
+      previous = (count == 0) ? (uint32_t)array_unzigzag(value) : previous + value;
+      self->data[count++] = (int)previous;
+      value = 0;
+      shift = 0;
+    }
+  }
+  free(chunk);
+  return ok && shift == 0 && count == size && adler == checksum;
+}
+
+bool array_load(struct array *self, int fd) {
+  array_clear(self);
+  unsigned char header[ARRAY_FORMAT_HEADER_SIZE];
+  if (array_read_all(fd, header, sizeof(header)) != (ssize_t)sizeof(header)) return false;
+  if (memcmp(header, "DARR", 4) != 0 || header[4] != ARRAY_FORMAT_VERSION || header[5] != sizeof(int)) return false;
+
+  uint64_t size = array_load_u64(header + 8);
+  uint64_t payload_size = array_load_u64(header + 16);
+  uint32_t checksum = array_load_u32(header + 24);
+  if (size > SIZE_MAX / sizeof(int) || !array_reserve(self, (size_t)size)) return false;
+
+  bool ok;
+  if (header[7] & ARRAY_FORMAT_DELTA_VARINT) {
+    ok = array_load_delta_varint(self, fd, size, payload_size, checksum);
+  } else {
+    ok = payload_size == size * sizeof(int)
+      && array_load_raw(self, fd, payload_size, checksum, header[6] != (array_big_endian() ? 1 : 0));
+  }
+  // the sorted flag of the header is not covered by the checksum, the cached one stays cleared
+  if (ok) self->size = (size_t)size;
+  return ok;
+}
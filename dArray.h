@@ -3,15 +3,106 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/*
+ * Growth policy used when the array needs more capacity
+ */
+enum array_growth {
+  ARRAY_GROWTH_DOUBLE, // capacity * 2
+  ARRAY_GROWTH_HALF,   // capacity * 1.5
+  ARRAY_GROWTH_CHUNK,  // capacity + growth_chunk
+};
+
+/*
+ * Instruction sets used by the scan kernels (search, equals, is_sorted, is_heap, set_intersection)
+ */
+enum array_simd {
+  ARRAY_SIMD_SCALAR,
+  ARRAY_SIMD_SSE2,
+  ARRAY_SIMD_AVX2,
+  ARRAY_SIMD_AVX512,
+};
+
+/*
+ * Number of elements stored inside struct array itself, the buffer is only allocated beyond that
+ */
+#ifndef ARRAY_INLINE_CAPACITY
+#define ARRAY_INLINE_CAPACITY 8
+#endif
+
+/*
+ * Allocator used for the buffers of an array, the sizes are in bytes and context is passed back to every function
+ */
+struct array_allocator {
+  void *(*alloc)(void *context, size_t bytes);
+  void *(*realloc)(void *context, void *ptr, size_t old_bytes, size_t new_bytes);
+  void (*free)(void *context, void *ptr, size_t bytes);
+  void *context;
+};
+
+#ifdef DARRAY_STATS
+/*
+ * Counters of what the arrays do, kept when the library is built with DARRAY_STATS (for one array
+ * and for all of them together). The comparisons are those of the partitions, insertion sorts and
+ * heaps (quick sort, selection, heap functions), the swaps those of array_swap
+ */
+struct array_stats {
+  uint64_t reallocs;      // buffers grown or shrunk
+  uint64_t bytes_copied;  // bytes of elements copied to a new buffer by the reallocations
+  uint64_t comparisons;
+  uint64_t swaps;
+  uint64_t peak_capacity; // largest capacity reached
+  uint64_t peak_size;     // largest number of elements the array was asked to hold
+  uint64_t sorts;         // calls to the sorts and the selection functions
+  uint64_t sort_ns;       // time spent in them
+  uint64_t searches;      // calls to the search functions
+  uint64_t search_ns;     // time spent in them
+};
+#endif
+
+/*
+ * Layout of the elements in the buffer
+ */
+enum array_storage {
+  ARRAY_STORAGE_CONTIGUOUS, // insert and remove shift the tail
+  ARRAY_STORAGE_GAP_BUFFER, // the free slots form a gap that follows the edits, edits close to each other are O(1)
+  ARRAY_STORAGE_TOMBSTONES, // remove marks the element dead, the dead slots are squeezed out later all at once
+};
+
+/*
+ * Flags of array_open_mmap
+ */
+enum array_mmap_flags {
+  ARRAY_MMAP_CREATE    = 1 << 0, // create the file if it does not exist
+  ARRAY_MMAP_READ_ONLY = 1 << 1, // map the file read-only (the array must not be modified)
+};
+
 struct array {
+  const struct array_allocator *allocator; // NULL for malloc/realloc/free
   int *data;
   size_t capacity;
   size_t size;
+  enum array_growth growth;
+  size_t growth_chunk;
+  int *scratch; // temporary buffer reused by the sorts
+  size_t scratch_capacity;
+  unsigned heap_arity; // number of children of a node in the heap functions (2, 4 or 8)
+  enum array_storage storage;
+  size_t gap;      // index of the element that follows the gap
+  size_t gap_size; // free slots between the elements, 0 when they are contiguous
+  size_t dead;     // removed elements whose slots are still in the buffer
+  uint64_t *tombstones; // bitmap of the dead slots and counts to index the live ones, NULL when none is dead
+  bool sorted;       // known to be sorted: set by the sorts, cleared by the changes that can break the order
+  bool sorted_cache; // array_is_sorted answers from sorted instead of scanning the elements
+#ifdef DARRAY_STATS
+  struct array_stats stats; // counters of this array, see array_stats_dump
+#endif
+  int inline_data[ARRAY_INLINE_CAPACITY]; // data points here while the elements fit
 };
 
 /*
@@ -20,12 +111,103 @@ struct array {
 void array_create(struct array *self);
 
 /*
- * Create an array with initial content
+ * Create an empty array whose buffers come from the allocator (it must outlive the array)
+ */
+void array_create_with_allocator(struct array *self, const struct array_allocator *allocator);
+
+/*
+ * Create an array with initial content, returns false if there is no memory for it
+ * (the array is then empty and must still be destroyed)
+ */
+bool array_create_from(struct array *self, const int *other, size_t size);
+
+/*
+ * Create an empty array that can hold capacity elements without reallocating (the memory is not initialized),
+ * returns false if there is no memory for them (the array is then created with its inline buffer)
  */
-void array_create_from(struct array *self, const int *other, size_t size);
+bool array_create_with_capacity(struct array *self, size_t capacity);
 
 /*
- * Destroy an array
+ * Create an array that takes ownership of buf (allocated with malloc) holding size elements out of cap, without copying
+ */
+void array_create_adopt(struct array *self, int *buf, size_t size, size_t cap);
+
+/*
+ * Move the content of other into self in O(1), self must not hold an array (not created or destroyed) and other is left empty
+ */
+void array_move(struct array *self, struct array *other);
+
+/*
+ * Exchange the contents of two arrays in O(1)
+ */
+void array_swap_contents(struct array *self, struct array *other);
+
+/*
+ * Create an array backed by a file of raw ints mapped in memory, returns false if the file cannot be opened or mapped
+ * (errno is EINVAL if its length is not a multiple of sizeof(int)). The array grows the file, and array_destroy trims
+ * the file to the size of the array and closes it
+ */
+bool array_open_mmap(struct array *self, const char *path, unsigned flags);
+
+/*
+ * Write the content of a file-backed array to the file and trim the file (and the capacity) to the size of the array,
+ * returns false on error (does nothing for the other arrays)
+ */
+bool array_sync(struct array *self);
+
+/*
+ * Flags of array_save
+ */
+enum array_save_flags {
+  ARRAY_SAVE_DELTA_VARINT = 1 << 0, // compress a sorted array as varint deltas (ignored if it is not sorted)
+};
+
+/*
+ * Write the array to a file descriptor in the binary format (versioned header with a checksum), returns false on error
+ */
+bool array_save(const struct array *self, int fd, unsigned flags);
+
+/*
+ * Replace the content of a created array with an array read from a file descriptor, returns false if it is not valid
+ */
+bool array_load(struct array *self, int fd);
+
+/*
+ * Choose how the array grows (chunk is only used by ARRAY_GROWTH_CHUNK)
+ */
+void array_set_growth(struct array *self, enum array_growth growth, size_t chunk);
+
+/*
+ * Make sure the array can hold at least n elements without reallocating, returns false if the allocation failed
+ */
+bool array_reserve(struct array *self, size_t n);
+
+/*
+ * Choose the layout used by insert and remove. A gap buffer keeps a gap of free slots where
+ * the last edit happened and only moves the elements between it and the next edit. Tombstones
+ * make remove mark the element dead, and the dead slots are squeezed out later in one pass.
+ * Get, set, push_back, pop_back, the range functions and the functions that take a const array work
+ * around the gap or the dead slots without moving them, the other functions close the gap or compact first
+ */
+void array_set_storage(struct array *self, enum array_storage storage);
+
+/*
+ * Squeeze out the slots of the elements removed with tombstones (done automatically when a quarter of the slots are dead)
+ */
+void array_compact(struct array *self);
+
+/*
+ * Remove all the elements, the capacity is kept
+ */
+void array_clear(struct array *self);
+
+/*
+ * Release the capacity that is not used by the elements (back to the inline buffer if they fit)
+ */
+void array_shrink_to_fit(struct array *self);
+
+/*
+ * Destroy an array (for a file-backed array, errno is set if the file could not be trimmed or closed)
  */
 void array_destroy(struct array *self);
 
@@ -64,6 +246,21 @@ void array_insert(struct array *self, int value, size_t index);
  */
 void array_remove(struct array *self, size_t index);
 
+/*
+ * Add k elements at the end of the array (src must not point into the array)
+ */
+void array_append_range(struct array *self, const int *src, size_t k);
+
+/*
+ * Insert k elements in the array at the specified index (preserving the order), or do nothing if the index is not valid
+ */
+void array_insert_range(struct array *self, size_t index, const int *src, size_t k);
+
+/*
+ * Remove the elements between first (inclusive) and last (exclusive), or do nothing if the range is not valid
+ */
+void array_erase_range(struct array *self, size_t first, size_t last);
+
 /*
  * Get an element at the specified index in the array, or 0 if the index is not valid
  */
@@ -80,30 +277,113 @@ void array_set(struct array *self, size_t index, int value);
 size_t array_search(const struct array *self, int value);
 
 /*
- * Search for an element in the sorted array.
+ * Search for an element in the sorted array (binary search).
  */
 size_t array_search_sorted(const struct array *self, int value);
 
+/*
+ * Get the index of the first element that is not less than value in the sorted array, or the size if there is none
+ */
+size_t array_lower_bound(const struct array *self, int value);
+
+/*
+ * Get the index of the first element that is greater than value in the sorted array, or the size if there is none
+ */
+size_t array_upper_bound(const struct array *self, int value);
+
 /*
  * Tell if the array is sorted
  */
 bool array_is_sorted(const struct array *self);
 
+/*
+ * Let array_is_sorted answer in O(1) once the array is known to be sorted (after a sort, or by a scan when
+ * the cache is turned on) until a change breaks the order. array_is_sorted itself never writes the cache. The elements must then only be changed through the array functions
+ */
+void array_cache_sorted(struct array *self, bool enabled);
+
+/*
+ * Insert an element in the sorted array after the elements equal to it
+ */
+void array_sorted_insert(struct array *self, int value);
+
+/*
+ * Insert k elements in the sorted array (src does not need to be sorted and must not point into the array):
+ * the batch is sorted on its own then merged from the end, so that each element is moved at most once
+ */
+void array_sorted_insert_batch(struct array *self, const int *src, size_t k);
+
+/*
+ * Merge the sorted arrays a and b into out, keeping every element (out must be another array), returns false if the allocation failed
+ */
+bool array_merge(const struct array *a, const struct array *b, struct array *out);
+
+/*
+ * Write each value found in the sorted array a or b once into out (out must be another array), returns false if the allocation failed
+ */
+bool array_set_union(const struct array *a, const struct array *b, struct array *out);
+
+/*
+ * Write each value found in both sorted arrays a and b once into out (out must be another array), returns false if the allocation failed
+ */
+bool array_set_intersection(const struct array *a, const struct array *b, struct array *out);
+
+/*
+ * Write each value of the sorted array a that is not in the sorted array b once into out (out must be another array), returns false if the allocation failed
+ */
+bool array_set_difference(const struct array *a, const struct array *b, struct array *out);
+
 /*
  * Make a partition of the array between i and j (inclusive) and returns the index of the pivot
  */
 ptrdiff_t array_partition(struct array *self, ptrdiff_t i, ptrdiff_t j);
 
 /*
- * Sort the array with quick sort
+ * Sort the array with quick sort (introsort: median pivot, heap sort when too deep, insertion sort for small ranges)
  */
 void array_quick_sort(struct array *self);
 
+/*
+ * Sort the array with pattern-defeating quick sort (branchless block partitions, close to linear on sorted
+ * ranges and on few distinct values, O(n log n) in the worst case)
+ */
+void array_pdq_sort(struct array *self);
+
+/*
+ * Sort the array with a stable merge sort (timsort: natural runs, galloping merges), in O(n) if it is already sorted
+ */
+void array_stable_sort(struct array *self);
+
+/*
+ * Sort the array with a LSD radix sort (8-bit digits)
+ */
+void array_radix_sort(struct array *self);
+
+/*
+ * Sort the array with a sample sort spread over several threads (0 means one per core)
+ */
+void array_parallel_sort(struct array *self, unsigned threads);
+
 /*
  * Sort the array with heap sort
  */
 void array_heap_sort(struct array *self);
 
+/*
+ * Put the element of rank k where a full sort would put it, with the smaller ones before and the larger ones after
+ */
+void array_nth_element(struct array *self, size_t k);
+
+/*
+ * Sort the k smallest elements at the start of the array, the others are left after them in no particular order
+ */
+void array_partial_sort(struct array *self, size_t k);
+
+/*
+ * Choose the number of children of a node (2, 4 or 8) used by the heap functions, the array must be made a heap again after a change
+ */
+void array_set_heap_arity(struct array *self, unsigned arity);
+
 /*
  * Tell if the array is a heap
  */
@@ -124,6 +404,54 @@ int array_heap_top(const struct array *self);
  */
 void array_heap_remove_top(struct array *self);
 
+/*
+ * Write the k largest values of the array into out in decreasing order (out must be another array),
+ * returns false if the allocation failed
+ */
+bool array_top_k(const struct array *self, size_t k, struct array *out);
+
+#ifdef DARRAY_STATS
+/*
+ * Formats of array_stats_dump
+ */
+enum array_stats_format {
+  ARRAY_STATS_TEXT, // one "name value" line per counter
+  ARRAY_STATS_JSON, // one object
+};
+
+/*
+ * Write the counters into buf as a string of at most size bytes, returns the length of the whole
+ * string like snprintf (it was cut if that is size or more)
+ */
+int array_stats_dump(char *buf, size_t size, const struct array_stats *stats, enum array_stats_format format);
+
+/*
+ * Get the counters of all the arrays together
+ */
+void array_stats_global(struct array_stats *stats);
+
+/*
+ * Set the counters of an array to zero
+ */
+void array_stats_reset(struct array *self);
+
+/*
+ * Set the counters of all the arrays together to zero
+ */
+void array_stats_reset_global(void);
+
+/*
+ * Call hook after each sort or search with the name of the function, the size of the array and
+ * the time it took (NULL to stop), it is shared by all the threads and must be set before they start
+ */
+void array_stats_set_hook(void (*hook)(void *context, const char *function, size_t size, uint64_t nanoseconds), void *context);
+#endif
+
+/*
+* Use the best scan kernels supported by the CPU up to max and return the chosen ones
+* (the best ones are selected when the program starts)
+*/
+enum array_simd array_simd_select(enum array_simd max);
 
 /*
 * Make copy of array in another array_get
@@ -131,9 +459,10 @@ void array_heap_remove_top(struct array *self);
 void array_copy(int *copy, const int *copied, size_t size);
 
 /*
-* Resize capacity of array if it necessary
+* Grow the capacity of the array (following its growth policy) so it can hold needed elements,
+* returns false if the allocation failed
 */
-void array_size_up(struct array *self,int *copied);
+bool array_size_up(struct array *self, size_t needed);
 
 /*
 * Sawp 2 elements of array
@@ -141,7 +470,7 @@ void array_size_up(struct array *self,int *copied);
 void array_swap(struct array *self, size_t i, size_t j);
 
 /*
-* 
+* Sort the elements between i and j (inclusive) with quick sort
 */
 void array_quick_sort_partial(struct array *self,ptrdiff_t i, ptrdiff_t j);
 
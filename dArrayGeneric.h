@@ -0,0 +1,562 @@
+#ifndef CONTAINERS_GENERIC_H
+#define CONTAINERS_GENERIC_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dArray.h"
+
+/*
+ * Type-generic arrays, written once as macros and instantiated per element type:
+ *
+ *   ARRAY_DEFINE_KERNELS(T, name, less) defines the searches, sorts and heap functions on T *
+ *   (name_bound, name_intro_sort, name_sift_down...). struct array is the int instantiation:
+ *   dArray.c uses ARRAY_DEFINE_KERNELS(int, array, ARRAY_LESS).
+ *
+ *   ARRAY_DEFINE(T, name, less) also defines struct name, an array of T with the same
+ *   functions as struct array (name_create, name_push_back, name_quick_sort...).
+ *
+ * less(a, b) is a macro or a function that tells if a goes before b (a strict weak order).
+ * T must be trivially copyable (any C type): the elements are moved with memcpy, memmove and realloc.
+ * Everything is static inline, so an instantiation can be repeated in each file that needs it.
+ *
+ * The kernels call ARRAY_KERNEL_COMPARE(n) for the comparisons and ARRAY_KERNEL_SWAP() for the swaps
+ * they make, define them before the instantiation to count them.
+ */
+
+#define ARRAY_LESS(a, b) ((a) < (b))
+
+#ifndef ARRAY_KERNEL_COMPARE
+#define ARRAY_KERNEL_COMPARE(n) ((void)0)
+#endif
+
+#ifndef ARRAY_KERNEL_SWAP
+#define ARRAY_KERNEL_SWAP() ((void)0)
+#endif
+
+#define ARRAY_MIN_CAPACITY 10
+
+/*
+ * Above this size the search prefetches both candidate midpoints of the next step,
+ * so that the memory latency is hidden behind the current comparison
+ */
+#define ARRAY_SEARCH_PREFETCH_THRESHOLD 4096
+
+/*
+ * Ranges smaller than this are finished with an insertion sort
+ */
+#define ARRAY_INSERTION_SORT_THRESHOLD 16
+
+/*
+ * Ranges larger than this take the pivot as the median of three medians (ninther)
+ */
+#define ARRAY_NINTHER_THRESHOLD 128
+
+/*
+ * Get the capacity after a growth that makes room for needed elements
+ */
+static inline size_t array_grown_capacity(size_t capacity, enum array_growth growth, size_t chunk, size_t needed) {
+  switch (growth) {
+    case ARRAY_GROWTH_CHUNK:
+      capacity += (chunk > 0) ? chunk : ARRAY_MIN_CAPACITY;
+      break;
+    case ARRAY_GROWTH_HALF:
+      capacity += capacity / 2;
+      break;
+    case ARRAY_GROWTH_DOUBLE:
+    default:
+      capacity *= 2;
+      break;
+  }
+  if (capacity < ARRAY_MIN_CAPACITY) capacity = ARRAY_MIN_CAPACITY;
+  if (capacity < needed) capacity = needed;
+  return capacity;
+}
+
+static inline unsigned array_log2(size_t n) {
+  unsigned log = 0;
+  while (n >>= 1) ++log;
+  return log;
+}
+
+#define ARRAY_DEFINE_KERNELS(T, name, less) \
+  \
+  /* Tell if the element belongs before the bound */ \
+  static inline bool name##_before(T element, T value, bool upper) { \
+    return upper ? !less(value, element) : less(element, value); \
+  } \
+  \
+  /* Branchless binary search: the only branch is the loop itself which runs exactly \
+   * ceil(log2(n)) times, the comparison is turned into an offset (inlined so that upper is a constant) */ \
+  static inline size_t name##_bound(const T *data, size_t n, T value, bool upper) { \
+    if (n == 0) return 0; \
+    const T *base = data; \
+    if (n >= ARRAY_SEARCH_PREFETCH_THRESHOLD) { \
+      while (n > 1) { \
+        size_t half = n / 2; \
+        __builtin_prefetch(base + half / 2); \
+        __builtin_prefetch(base + half + half / 2); \
+        base += (size_t)name##_before(base[half], value, upper) * half; \
+        n -= half; \
+      } \
+    } else { \
+      while (n > 1) { \
+        size_t half = n / 2; \
+        base += (size_t)name##_before(base[half], value, upper) * half; \
+        n -= half; \
+      } \
+    } \
+    return (size_t)(base - data) + name##_before(*base, value, upper); \
+  } \
+  \
+  /* Exponential search: probe 1, 2, 4... elements ahead, then search the last window, so that finding \
+   * a bound at distance d costs O(log d) whatever the size of the range */ \
+  static inline size_t name##_gallop(const T *data, size_t n, T value, bool upper) { \
+    size_t hi = 1; \
+    while (hi < n && name##_before(data[hi - 1], value, upper)) { \
+      hi *= 2; \
+    } \
+    size_t lo = hi / 2; \
+    if (hi > n) hi = n; \
+    return lo + name##_bound(data + lo, hi - lo, value, upper); \
+  } \
+  \
+  /* Same as name##_gallop, probing from the end of the range */ \
+  static inline size_t name##_gallop_back(const T *data, size_t n, T value, bool upper) { \
+    size_t hi = 1; \
+    while (hi < n && !name##_before(data[n - hi], value, upper)) { \
+      hi *= 2; \
+    } \
+    size_t end = n - hi / 2; \
+    size_t start = (hi >= n) ? 0 : n - hi; \
+    return start + name##_bound(data + start, end - start, value, upper); \
+  } \
+  \
+  static inline bool name##_is_sorted_range(const T *data, size_t n) { \
+    for (size_t i = 1; i < n; ++i) { \
+      if (less(data[i], data[i - 1])) return false; \
+    } \
+    return true; \
+  } \
+  \
+  static inline void name##_swap_elements(T *data, size_t i, size_t j) { \
+    ARRAY_KERNEL_SWAP(); \
+    T stock = data[i]; \
+    data[i] = data[j]; \
+    data[j] = stock; \
+  } \
+  \
+  /* Sort the elements between i and j (inclusive) */ \
+  static inline void name##_insertion_sort_range(T *data, ptrdiff_t i, ptrdiff_t j) { \
+    for (ptrdiff_t k = i + 1; k <= j; ++k) { \
+      T value = data[k]; \
+      ptrdiff_t l = k; \
+      while (l > i && less(value, data[l - 1])) { \
+        data[l] = data[l - 1]; \
+        --l; \
+      } \
+      ARRAY_KERNEL_COMPARE((uint64_t)(k - l) + (l > i)); \
+      data[l] = value; \
+    } \
+  } \
+  \
+  static inline ptrdiff_t name##_median_of_three(const T *data, ptrdiff_t a, ptrdiff_t b, ptrdiff_t c) { \
+    ARRAY_KERNEL_COMPARE(3); \
+    if (less(data[a], data[b])) { \
+      if (less(data[b], data[c])) return b; \
+      return less(data[a], data[c]) ? c : a; \
+    } \
+    if (less(data[a], data[c])) return a; \
+    return less(data[b], data[c]) ? c : b; \
+  } \
+  \
+  /* Partition the elements between i and j (inclusive) around the one at i, returns its final place */ \
+  static inline ptrdiff_t name##_partition_range(T *data, ptrdiff_t i, ptrdiff_t j) { \
+    const T pivot = data[i]; \
+    name##_swap_elements(data, (size_t)i, (size_t)j); \
+    ptrdiff_t l = i; \
+    for (ptrdiff_t k = i; k < j; ++k) { \
+      if (less(data[k], pivot)) { \
+        name##_swap_elements(data, (size_t)k, (size_t)l); \
+        ++l; \
+      } \
+    } \
+    ARRAY_KERNEL_COMPARE((uint64_t)(j - i)); \
+    name##_swap_elements(data, (size_t)l, (size_t)j); \
+    return l; \
+  } \
+  \
+  /* Move a good pivot at index i, where name##_partition_range expects it */ \
+  static inline void name##_choose_pivot(T *data, ptrdiff_t i, ptrdiff_t j) { \
+    ptrdiff_t n = j - i + 1; \
+    ptrdiff_t m = i + n / 2; \
+    ptrdiff_t p; \
+    if (n > ARRAY_NINTHER_THRESHOLD) { \
+      ptrdiff_t s = n / 8; \
+      p = name##_median_of_three(data, \
+        name##_median_of_three(data, i, i + s, i + 2 * s), \
+        name##_median_of_three(data, m - s, m, m + s), \
+        name##_median_of_three(data, j - 2 * s, j - s, j)); \
+    } else { \
+      p = name##_median_of_three(data, i, m, j); \
+    } \
+    name##_swap_elements(data, (size_t)i, (size_t)p); \
+  } \
+  \
+  /* Binary heap sift-down, iterative and moving a hole instead of swapping */ \
+  static inline void name##_sift_down(T *data, size_t n, size_t i) { \
+    T value = data[i]; \
+    size_t child; \
+    while ((child = 2 * i + 1) < n) { \
+      ARRAY_KERNEL_COMPARE(2); \
+      if (child + 1 < n && less(data[child], data[child + 1])) ++child; \
+      if (!less(value, data[child])) break; \
+      data[i] = data[child]; \
+      i = child; \
+    } \
+    data[i] = value; \
+  } \
+  \
+  /* Floyd's bottom-up sift-down: the hole sinks to a leaf through the larger children \
+   * (one comparison per level), then the value climbs back up. The value comes from the \
+   * bottom of the heap so it rarely climbs far, which saves about half of the comparisons */ \
+  static inline void name##_sift_down_floyd(T *data, size_t n, size_t i) { \
+    size_t top = i; \
+    T value = data[i]; \
+    size_t child; \
+    while ((child = 2 * i + 1) < n) { \
+      ARRAY_KERNEL_COMPARE(1); \
+      if (child + 1 < n && less(data[child], data[child + 1])) ++child; \
+      data[i] = data[child]; \
+      i = child; \
+    } \
+    while (i > top) { \
+      ARRAY_KERNEL_COMPARE(1); \
+      size_t parent = (i - 1) / 2; \
+      if (!less(data[parent], value)) break; \
+      data[i] = data[parent]; \
+      i = parent; \
+    } \
+    data[i] = value; \
+  } \
+  \
+  /* d-ary sift-down, inlined with a constant d so that the scan of the siblings is unrolled and branchless */ \
+  static inline void name##_sift_down_dary_fixed(T *data, size_t n, size_t i, unsigned d) { \
+    T value = data[i]; \
+    for (;;) { \
+      size_t first = d * i + 1; \
+      if (first >= n) break; \
+      size_t last = (first + d < n) ? first + d : n; \
+      ARRAY_KERNEL_COMPARE(last - first); \
+      size_t largest = first; \
+      T max = data[first]; \
+      if (last == first + d) { \
+        for (unsigned k = 1; k < d; ++k) { \
+          T child = data[first + k]; \
+          largest = less(max, child) ? first + k : largest; \
+          max = less(max, child) ? child : max; \
+        } \
+      } else { \
+        for (size_t k = first + 1; k < last; ++k) { \
+          largest = less(max, data[k]) ? k : largest; \
+          max = less(max, data[k]) ? data[k] : max; \
+        } \
+      } \
+      if (!less(value, max)) break; \
+      data[i] = max; \
+      i = largest; \
+    } \
+    data[i] = value; \
+  } \
+  \
+  static inline void name##_sift_down_dary(T *data, size_t n, size_t i, unsigned d) { \
+    switch (d) { \
+      case 4: name##_sift_down_dary_fixed(data, n, i, 4); break; \
+      case 8: name##_sift_down_dary_fixed(data, n, i, 8); break; \
+      default: name##_sift_down_dary_fixed(data, n, i, d); break; \
+    } \
+  } \
+  \
+  /* Move the element at i up the d-ary heap */ \
+  static inline void name##_sift_up(T *data, size_t i, unsigned d) { \
+    T value = data[i]; \
+    while (i > 0) { \
+      ARRAY_KERNEL_COMPARE(1); \
+      size_t parent = (i - 1) / d; \
+      if (!less(data[parent], value)) break; \
+      data[i] = data[parent]; \
+      i = parent; \
+    } \
+    data[i] = value; \
+  } \
+  \
+  static inline bool name##_is_heap_range(const T *data, size_t n, unsigned d) { \
+    for (size_t k = 1; k < n; ++k) { \
+      if (less(data[(k - 1) / d], data[k])) return false; \
+    } \
+    return true; \
+  } \
+  \
+  /* Heap sort with d children per node, the binary one extracts with Floyd's sift-down */ \
+  static inline void name##_heap_sort_range(T *data, size_t n, unsigned d) { \
+    if (n < 2) return; \
+    for (size_t i = (n - 2) / d + 1; i-- > 0;) { \
+      if (d == 2) { \
+        name##_sift_down(data, n, i); \
+      } else { \
+        name##_sift_down_dary(data, n, i, d); \
+      } \
+    } \
+    for (size_t i = n - 1; i > 0; --i) { \
+      name##_swap_elements(data, 0, i); \
+      if (d == 2) { \
+        name##_sift_down_floyd(data, i, 0); \
+      } else { \
+        name##_sift_down_dary(data, i, 0, d); \
+      } \
+    } \
+  } \
+  \
+  /* Introsort: quick sort that recurses on the smaller side only (so the stack stays \
+   * in O(log n)) and switches to heap sort when the partitions keep being unbalanced */ \
+  static inline void name##_intro_sort(T *data, ptrdiff_t i, ptrdiff_t j, unsigned depth) { \
+    while (j - i + 1 > ARRAY_INSERTION_SORT_THRESHOLD) { \
+      if (depth == 0) { \
+        name##_heap_sort_range(data + i, (size_t)(j - i + 1), 2); \
+        return; \
+      } \
+      --depth; \
+      name##_choose_pivot(data, i, j); \
+      ptrdiff_t p = name##_partition_range(data, i, j); \
+      if (p - i < j - p) { \
+        name##_intro_sort(data, i, p - 1, depth); \
+        i = p + 1; \
+      } else { \
+        name##_intro_sort(data, p + 1, j, depth); \
+        j = p - 1; \
+      } \
+    } \
+    name##_insertion_sort_range(data, i, j); \
+  } \
+  \
+  /* Introselect: quick sort that only keeps the side holding k, with the same pivots, and \
+   * heap sort of the remaining range when the partitions keep being unbalanced */ \
+  static inline void name##_select(T *data, size_t n, size_t k) { \
+    ptrdiff_t i = 0; \
+    ptrdiff_t j = (ptrdiff_t)n - 1; \
+    ptrdiff_t target = (ptrdiff_t)k; \
+    unsigned depth = 2 * array_log2(n); \
+    while (j - i + 1 > ARRAY_INSERTION_SORT_THRESHOLD) { \
+      if (depth == 0) { \
+        name##_heap_sort_range(data + i, (size_t)(j - i + 1), 2); \
+        return; \
+      } \
+      --depth; \
+      name##_choose_pivot(data, i, j); \
+      ptrdiff_t p = name##_partition_range(data, i, j); \
+      if (p == target) return; \
+      if (target < p) { \
+        j = p - 1; \
+      } else { \
+        i = p + 1; \
+      } \
+    } \
+    name##_insertion_sort_range(data, i, j); \
+  }
+
+#define ARRAY_DEFINE(T, name, less) \
+  \
+  ARRAY_DEFINE_KERNELS(T, name, less) \
+  \
+  struct name { \
+    T *data; \
+    size_t capacity; \
+    size_t size; \
+    enum array_growth growth; \
+    size_t growth_chunk; \
+  }; \
+  \
+  static inline void name##_create(struct name *self) { \
+    self->data = NULL; \
+    self->capacity = 0; \
+    self->size = 0; \
+    self->growth = ARRAY_GROWTH_DOUBLE; \
+    self->growth_chunk = 0; \
+  } \
+  \
+  static inline void name##_destroy(struct name *self) { \
+    free(self->data); \
+  } \
+  \
+  static inline bool name##_realloc(struct name *self, size_t capacity) { \
+    if (capacity > SIZE_MAX / sizeof(T)) return false; \
+    T *data = (T *)realloc(self->data, capacity * sizeof(T)); \
+    if (data == NULL) return false; \
+    self->data = data; \
+    self->capacity = capacity; \
+    return true; \
+  } \
+  \
+  /* Grow the capacity (following the growth policy) so the array can hold needed elements */ \
+  static inline bool name##_size_up(struct name *self, size_t needed) { \
+    if (needed <= self->capacity) return true; \
+    return name##_realloc(self, array_grown_capacity(self->capacity, self->growth, self->growth_chunk, needed)); \
+  } \
+  \
+  static inline void name##_set_growth(struct name *self, enum array_growth growth, size_t chunk) { \
+    self->growth = growth; \
+    self->growth_chunk = chunk; \
+  } \
+  \
+  static inline bool name##_reserve(struct name *self, size_t n) { \
+    if (n <= self->capacity) return true; \
+    return name##_realloc(self, n); \
+  } \
+  \
+  static inline void name##_shrink_to_fit(struct name *self) { \
+    if (self->size == self->capacity) return; \
+    if (self->size == 0) { \
+      free(self->data); \
+      name##_create(self); \
+      return; \
+    } \
+    name##_realloc(self, self->size); \
+  } \
+  \
+  static inline bool name##_empty(const struct name *self) { \
+    return self->size == 0; \
+  } \
+  \
+  static inline size_t name##_size(const struct name *self) { \
+    return self->size; \
+  } \
+  \
+  /* Add k elements at the end of the array (src must not point into the array) */ \
+  static inline void name##_append_range(struct name *self, const T *src, size_t k) { \
+    if (k == 0 || !name##_size_up(self, self->size + k)) return; \
+    memcpy(self->data + self->size, src, k * sizeof(T)); \
+    self->size += k; \
+  } \
+  \
+  static inline void name##_create_from(struct name *self, const T *other, size_t size) { \
+    name##_create(self); \
+    name##_append_range(self, other, size); \
+  } \
+  \
+  static inline void name##_push_back(struct name *self, T value) { \
+    name##_append_range(self, &value, 1); \
+  } \
+  \
+  static inline void name##_pop_back(struct name *self) { \
+    if (self->size > 0) self->size -= 1; \
+  } \
+  \
+  /* Insert k elements at the index (preserving the order), or do nothing if the index is not valid */ \
+  static inline void name##_insert_range(struct name *self, size_t index, const T *src, size_t k) { \
+    if (index > self->size || k == 0 || !name##_size_up(self, self->size + k)) return; \
+    memmove(self->data + index + k, self->data + index, (self->size - index) * sizeof(T)); \
+    memcpy(self->data + index, src, k * sizeof(T)); \
+    self->size += k; \
+  } \
+  \
+  static inline void name##_insert(struct name *self, T value, size_t index) { \
+    name##_insert_range(self, index, &value, 1); \
+  } \
+  \
+  /* Remove the elements between first (inclusive) and last (exclusive), or do nothing if the range is not valid */ \
+  static inline void name##_erase_range(struct name *self, size_t first, size_t last) { \
+    if (first >= last || last > self->size) return; \
+    memmove(self->data + first, self->data + last, (self->size - last) * sizeof(T)); \
+    self->size -= last - first; \
+  } \
+  \
+  static inline void name##_remove(struct name *self, size_t index) { \
+    name##_erase_range(self, index, index + 1); \
+  } \
+  \
+  /* Get the element at the index, or a zeroed one if the index is not valid */ \
+  static inline T name##_get(const struct name *self, size_t index) { \
+    if (index < self->size) return self->data[index]; \
+    T zero; \
+    memset(&zero, 0, sizeof(T)); \
+    return zero; \
+  } \
+  \
+  static inline void name##_set(struct name *self, size_t index, T value) { \
+    if (index < self->size) self->data[index] = value; \
+  } \
+  \
+  /* Compare the array to another array, the elements are equal when neither goes before the other */ \
+  static inline bool name##_equals(const struct name *self, const T *content, size_t size) { \
+    if (self->size != size) return false; \
+    for (size_t i = 0; i < size; ++i) { \
+      if (less(self->data[i], content[i]) || less(content[i], self->data[i])) return false; \
+    } \
+    return true; \
+  } \
+  \
+  static inline size_t name##_lower_bound(const struct name *self, T value) { \
+    return name##_bound(self->data, self->size, value, false); \
+  } \
+  \
+  static inline size_t name##_upper_bound(const struct name *self, T value) { \
+    return name##_bound(self->data, self->size, value, true); \
+  } \
+  \
+  /* Search for an element in the sorted array, returns its index or the size */ \
+  static inline size_t name##_search_sorted(const struct name *self, T value) { \
+    size_t i = name##_lower_bound(self, value); \
+    if (i < self->size && !less(value, self->data[i])) return i; \
+    return self->size; \
+  } \
+  \
+  static inline bool name##_is_sorted(const struct name *self) { \
+    return name##_is_sorted_range(self->data, self->size); \
+  } \
+  \
+  static inline void name##_quick_sort(struct name *self) { \
+    if (self->size > 1) name##_intro_sort(self->data, 0, (ptrdiff_t)self->size - 1, 2 * array_log2(self->size)); \
+  } \
+  \
+  static inline void name##_heap_sort(struct name *self) { \
+    name##_heap_sort_range(self->data, self->size, 2); \
+  } \
+  \
+  static inline void name##_nth_element(struct name *self, size_t k) { \
+    if (k < self->size) name##_select(self->data, self->size, k); \
+  } \
+  \
+  static inline void name##_partial_sort(struct name *self, size_t k) { \
+    if (k == 0) return; \
+    if (k >= self->size) { \
+      name##_quick_sort(self); \
+      return; \
+    } \
+    name##_select(self->data, self->size, k - 1); \
+    if (k > 1) name##_intro_sort(self->data, 0, (ptrdiff_t)k - 2, 2 * array_log2(k - 1)); \
+  } \
+  \
+  static inline bool name##_is_heap(const struct name *self) { \
+    return name##_is_heap_range(self->data, self->size, 2); \
+  } \
+  \
+  static inline void name##_heap_add(struct name *self, T value) { \
+    size_t i = self->size; \
+    name##_push_back(self, value); \
+    if (self->size > i) name##_sift_up(self->data, i, 2); \
+  } \
+  \
+  static inline T name##_heap_top(const struct name *self) { \
+    return name##_get(self, 0); \
+  } \
+  \
+  static inline void name##_heap_remove_top(struct name *self) { \
+    if (self->size == 0) return; \
+    self->size -= 1; \
+    self->data[0] = self->data[self->size]; \
+    name##_sift_down_floyd(self->data, self->size, 0); \
+  }
+
+#endif // CONTAINERS_GENERIC_H
@@ -0,0 +1,158 @@
+#include "dConcurrent.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_CONCURRENT_FIRST_SEGMENT_LOG2 __builtin_ctz(ARRAY_CONCURRENT_FIRST_SEGMENT)
+
+/*
+ * A segment is one allocation: the ready bitmap (one bit per slot) followed by the slots
+ */
+static size_t array_concurrent_segment_size(unsigned segment) {
+  return (size_t)ARRAY_CONCURRENT_FIRST_SEGMENT << segment;
+}
+
+static size_t array_concurrent_bitmap_words(unsigned segment) {
+  return array_concurrent_segment_size(segment) / 64;
+}
+
+static int *array_concurrent_slots(const uint64_t *segment_data, unsigned segment) {
+  return (int *)(segment_data + array_concurrent_bitmap_words(segment));
+}
+
+/*
+ * The segment s starts at index FIRST * (2^s - 1), so the segment of an index comes from the
+ * position of the highest bit of index + FIRST
+ */
+static unsigned array_concurrent_locate(size_t index, size_t *offset) {
+  uint64_t shifted = (uint64_t)index + ARRAY_CONCURRENT_FIRST_SEGMENT;
+  unsigned high = 63 - (unsigned)__builtin_clzll(shifted);
+  *offset = (size_t)(shifted - (UINT64_C(1) << high));
+  return high - ARRAY_CONCURRENT_FIRST_SEGMENT_LOG2;
+}
+
+/*
+ * Get a segment, allocating it if needed: when several writers race, one of them installs
+ * its segment and the others free theirs
+ */
+static uint64_t *array_concurrent_segment(struct array_concurrent *self, unsigned segment) {
+  if (segment >= ARRAY_CONCURRENT_SEGMENTS) return NULL;
+  uint64_t *data = __atomic_load_n(&self->segments[segment], __ATOMIC_ACQUIRE);
+  if (data != NULL) return data;
+  size_t words = array_concurrent_bitmap_words(segment);
+  uint64_t *fresh = malloc(words * sizeof(uint64_t) + array_concurrent_segment_size(segment) * sizeof(int));
+  if (fresh == NULL) return NULL;
+  memset(fresh, 0, words * sizeof(uint64_t));
+  if (__atomic_compare_exchange_n(&self->segments[segment], &data, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    return fresh;
+  }
+  free(fresh);
+  return data;
+}
+
+/*
+ * Get a segment for reading, NULL if it does not exist yet
+ */
+static const uint64_t *array_concurrent_published(const struct array_concurrent *self, unsigned segment) {
+  if (segment >= ARRAY_CONCURRENT_SEGMENTS) return NULL;
+  return __atomic_load_n(&self->segments[segment], __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Mark the slots [offset, offset + k) of a segment as written, the release makes
+ * their values visible to the readers that see the bits
+ */
+static void array_concurrent_mark(uint64_t *bitmap, size_t offset, size_t k) {
+  while (k > 0) {
+    size_t bit = offset % 64;
+    size_t count = (k < 64 - bit) ? k : 64 - bit;
+    uint64_t mask = (count == 64) ? ~UINT64_C(0) : ((UINT64_C(1) << count) - 1) << bit;
+    __atomic_fetch_or(&bitmap[offset / 64], mask, __ATOMIC_RELEASE);
+    offset += count;
+    k -= count;
+  }
+}
+
+void array_concurrent_create(struct array_concurrent *self) {
+  memset(self->segments, 0, sizeof(self->segments));
+  self->reserved = 0;
+  self->published = 0;
+}
+
+void array_concurrent_destroy(struct array_concurrent *self) {
+  for (unsigned s = 0; s < ARRAY_CONCURRENT_SEGMENTS; ++s) {
+    free(self->segments[s]);
+    self->segments[s] = NULL;
+  }
+  self->reserved = 0;
+  self->published = 0;
+}
+
+bool array_concurrent_append_range(struct array_concurrent *self, const int *src, size_t k) {
+  size_t index = __atomic_fetch_add(&self->reserved, k, __ATOMIC_RELAXED);
+  size_t done = 0;
+  while (done < k) {
+    size_t offset;
+    unsigned segment = array_concurrent_locate(index, &offset);
+    uint64_t *data = array_concurrent_segment(self, segment);
+    if (data == NULL) return false;
+    size_t count = array_concurrent_segment_size(segment) - offset;
+    if (count > k - done) count = k - done;
+    memcpy(array_concurrent_slots(data, segment) + offset, src + done, count * sizeof(int));
+    array_concurrent_mark(data, offset, count);
+    index += count;
+    done += count;
+  }
+  return true;
+}
+
+bool array_concurrent_push_back(struct array_concurrent *self, int value) {
+  return array_concurrent_append_range(self, &value, 1);
+}
+
+/*
+ * Scan the ready bits from the last known end of the published prefix, then move
+ * that end forward for the next readers (only ever forward)
+ */
+size_t array_concurrent_size(struct array_concurrent *self) {
+  size_t start = __atomic_load_n(&self->published, __ATOMIC_ACQUIRE);
+  size_t n = start;
+  for (;;) {
+    size_t offset;
+    unsigned segment = array_concurrent_locate(n, &offset);
+    const uint64_t *bitmap = array_concurrent_published(self, segment);
+    if (bitmap == NULL) break;
+    size_t bit = offset % 64;
+    uint64_t missing = ~(__atomic_load_n(&bitmap[offset / 64], __ATOMIC_ACQUIRE) >> bit);
+    size_t ready = (missing == 0) ? 64 : (size_t)__builtin_ctzll(missing);
+    n += ready;
+    if (ready < 64 - bit) break;
+  }
+  size_t expected = start;
+  while (expected < n && !__atomic_compare_exchange_n(&self->published, &expected, n, true, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+  }
+  return n;
+}
+
+int array_concurrent_get(const struct array_concurrent *self, size_t index) {
+  size_t offset;
+  unsigned segment = array_concurrent_locate(index, &offset);
+  const uint64_t *data = array_concurrent_published(self, segment);
+  return array_concurrent_slots(data, segment)[offset];
+}
+
+bool array_concurrent_snapshot(struct array_concurrent *self, struct array *out) {
+  size_t n = array_concurrent_size(self);
+  array_clear(out);
+  if (!array_reserve(out, n)) return false;
+  size_t index = 0;
+  for (unsigned segment = 0; index < n; ++segment) {
+    size_t count = array_concurrent_segment_size(segment);
+    if (count > n - index) count = n - index;
+    const uint64_t *data = array_concurrent_published(self, segment);
+    memcpy(out->data + index, array_concurrent_slots(data, segment), count * sizeof(int));
+    index += count;
+  }
+  out->size = n;
+  return true;
+}
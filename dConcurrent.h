@@ -0,0 +1,75 @@
+#ifndef CONCURRENT_H
+#define CONCURRENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "dArray.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Size of the first segment, each next segment is twice as big as the previous one
+ */
+#define ARRAY_CONCURRENT_FIRST_SEGMENT 64
+
+#define ARRAY_CONCURRENT_SEGMENTS 40
+
+/*
+ * Array where many threads can append at the same time. A writer reserves its slots with
+ * an atomic increment, writes them and sets their ready bits, so writers never wait for
+ * each other. The elements live in segments that are never moved or freed before the array
+ * is destroyed, so a reader never sees a buffer being reallocated. Readers see the longest
+ * prefix of written slots.
+ */
+struct array_concurrent {
+  uint64_t *segments[ARRAY_CONCURRENT_SEGMENTS]; // ready bitmap then slots
+  size_t reserved __attribute__((aligned(64)));  // slots given to the writers
+  size_t published __attribute__((aligned(64))); // known length of the written prefix
+};
+
+/*
+ * Create an empty concurrent array
+ */
+void array_concurrent_create(struct array_concurrent *self);
+
+/*
+ * Destroy the concurrent array (no thread may use it anymore)
+ */
+void array_concurrent_destroy(struct array_concurrent *self);
+
+/*
+ * Append a value, can be called from any number of threads, returns false if the allocation failed
+ * (the readers then never see the elements appended after it)
+ */
+bool array_concurrent_push_back(struct array_concurrent *self, int value);
+
+/*
+ * Append k values in consecutive slots, same as array_concurrent_push_back otherwise
+ */
+bool array_concurrent_append_range(struct array_concurrent *self, const int *src, size_t k);
+
+/*
+ * Get the number of elements written without a gap from the start, they can be read while the writers go on
+ */
+size_t array_concurrent_size(struct array_concurrent *self);
+
+/*
+ * Get a published element (index must be less than a size returned by array_concurrent_size)
+ */
+int array_concurrent_get(const struct array_concurrent *self, size_t index);
+
+/*
+ * Copy the elements written without a gap from the start into out without blocking the writers,
+ * returns false if the allocation failed
+ */
+bool array_concurrent_snapshot(struct array_concurrent *self, struct array *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONCURRENT_H
@@ -1,11 +1,25 @@
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cerrno>
 #include <cstdlib>
 #include <cstring>
 #include <array>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "dArray.h"
+#include "dArrayGeneric.h"
+#include "dAllocator.h"
+#include "dConcurrent.h"
 
 #define BIG_SIZE 1000
 
@@ -49,771 +63,3626 @@ TEST(ArrayCreateFromTest, ManyElements) {
   array_destroy(&a);
 }
 
-/*
- * array_equals
- */
-
-TEST(ArrayEqualsTest, DifferentElement) {
-  static const int origin[]    = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
-  static const int reference[] = { 1, 2, 3, 4, 5, 6, 7, 8, 10 };
+TEST(ArrayCreateFromTest, TooLarge) {
+  static const int origin[] = { 1 };
 
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  EXPECT_FALSE(array_create_from(&a, origin, SIZE_MAX / 4));
 
-  EXPECT_FALSE(array_equals(&a, reference, std::size(reference)));
+  EXPECT_TRUE(array_empty(&a));
 
   array_destroy(&a);
 }
 
-TEST(ArrayEqualsTest, SizeShorter) {
-  static const int origin[]    = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
-  static const int reference[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+/*
+ * array_create_with_capacity
+ */
 
+TEST(ArrayCreateWithCapacityTest, Stressed) {
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  array_create_with_capacity(&a, BIG_SIZE);
 
-  EXPECT_FALSE(array_equals(&a, reference, std::size(reference)));
+  EXPECT_TRUE(array_empty(&a));
+  EXPECT_EQ(a.capacity, static_cast<std::size_t>(BIG_SIZE));
+
+  int *data = a.data;
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
+  }
+  EXPECT_EQ(a.data, data);
 
   array_destroy(&a);
 }
 
-TEST(ArrayEqualsTest, SizeLarger) {
-  static const int origin[]    = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
-  static const int reference[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
-
+TEST(ArrayCreateWithCapacityTest, TooLarge) {
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  EXPECT_FALSE(array_create_with_capacity(&a, SIZE_MAX));
 
-  EXPECT_FALSE(array_equals(&a, reference, std::size(reference)));
+  EXPECT_TRUE(array_empty(&a));
+  EXPECT_EQ(a.capacity, static_cast<std::size_t>(ARRAY_INLINE_CAPACITY));
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
+  }
+  EXPECT_EQ(array_get(&a, BIG_SIZE - 1), BIG_SIZE - 1);
 
   array_destroy(&a);
 }
 
 /*
- * array_push_back
+ * array_create_adopt
  */
 
-TEST(ArrayPushBackTest, OneElement) {
+TEST(ArrayCreateAdoptTest, ManyElements) {
+  int *buf = static_cast<int *>(std::malloc(20 * sizeof(int)));
+  for (int i = 0; i < 10; ++i) {
+    buf[i] = i;
+  }
+
   struct array a;
-  array_create(&a);
-  array_push_back(&a, 1);
+  array_create_adopt(&a, buf, 10, 20);
 
-  EXPECT_FALSE(array_empty(&a));
-  EXPECT_TRUE(array_size(&a) == 1);
-  EXPECT_EQ(array_get(&a, 0), 1);
+  EXPECT_EQ(a.data, buf);
+  EXPECT_EQ(array_size(&a), 10u);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(array_get(&a, i), i);
+  }
+
+  for (int i = 10; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
+  }
+  EXPECT_EQ(array_get(&a, BIG_SIZE - 1), BIG_SIZE - 1);
 
   array_destroy(&a);
 }
 
-TEST(ArrayPushBackTest, ManyElements) {
+/*
+ * array_move
+ */
+
+TEST(ArrayMoveTest, Heap) {
   static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
 
   struct array a;
-  array_create(&a);
+  array_create_from(&a, origin, std::size(origin));
+  int *data = a.data;
 
-  for (size_t i = 0; i < std::size(origin); ++i) {
-    array_push_back(&a, origin[i]);
-  }
+  struct array b;
+  array_move(&b, &a);
 
-  EXPECT_FALSE(array_empty(&a));
-  EXPECT_EQ(array_size(&a), std::size(origin));
+  EXPECT_EQ(b.data, data);
+  EXPECT_TRUE(array_equals(&b, origin, std::size(origin)));
+  EXPECT_TRUE(array_empty(&a));
 
+  array_push_back(&a, 1);
+  EXPECT_EQ(array_get(&a, 0), 1);
 
-  for (size_t i = 0; i < std::size(origin); ++i) {
-    EXPECT_EQ(array_get(&a, i), origin[i]);
-  }
+  array_destroy(&a);
+  array_destroy(&b);
+}
 
-  EXPECT_TRUE(array_equals(&a, origin, std::size(origin)));
+TEST(ArrayMoveTest, Inline) {
+  static const int origin[] = { 1, 2, 3 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  struct array b;
+  array_move(&b, &a);
+
+  EXPECT_EQ(b.data, b.inline_data);
+  EXPECT_TRUE(array_equals(&b, origin, std::size(origin)));
+  EXPECT_TRUE(array_empty(&a));
 
   array_destroy(&a);
+  array_destroy(&b);
 }
 
-TEST(ArrayPushBackTest, Stressed) {
+/*
+ * array_swap_contents
+ */
+
+TEST(ArraySwapContentsTest, InlineAndHeap) {
+  static const int small[] = { 1, 2, 3 };
+  static const int big[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
   struct array a;
+  array_create_from(&a, small, std::size(small));
+  struct array b;
+  array_create_from(&b, big, std::size(big));
+  int *data = b.data;
 
-  array_create(&a);
+  array_swap_contents(&a, &b);
 
-  for (int i = 0; i < BIG_SIZE; ++i) {
-    array_push_back(&a, i + 1);
-    EXPECT_EQ(array_size(&a), static_cast<std::size_t>(i + 1));
-  }
+  EXPECT_EQ(a.data, data);
+  EXPECT_TRUE(array_equals(&a, big, std::size(big)));
+  EXPECT_EQ(b.data, b.inline_data);
+  EXPECT_TRUE(array_equals(&b, small, std::size(small)));
 
-  EXPECT_FALSE(array_empty(&a));
+  array_swap_contents(&a, &b);
 
-  for (int i = 0; i < BIG_SIZE; ++i) {
-    EXPECT_EQ(array_get(&a, i), i + 1);
-  }
+  EXPECT_EQ(a.data, a.inline_data);
+  EXPECT_TRUE(array_equals(&a, small, std::size(small)));
+  EXPECT_EQ(b.data, data);
+  EXPECT_TRUE(array_equals(&b, big, std::size(big)));
 
   array_destroy(&a);
+  array_destroy(&b);
 }
 
 /*
- * array_pop_back
+ * array_open_mmap
  */
 
-TEST(ArrayPopBackTest, OneElement) {
-  static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+static std::string temp_path(const char *name) {
+  std::string path = testing::TempDir() + name;
+  std::remove(path.c_str());
+  return path;
+}
+
+static long file_size(const std::string& path) {
+  FILE *file = std::fopen(path.c_str(), "rb");
+  std::fseek(file, 0, SEEK_END);
+  long size = std::ftell(file);
+  std::fclose(file);
+  return size;
+}
+
+TEST(ArrayOpenMmapTest, CreateAndReload) {
+  std::string path = temp_path("array_mmap_reload.bin");
 
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), ARRAY_MMAP_CREATE));
+  EXPECT_TRUE(array_empty(&a));
 
-  EXPECT_EQ(array_size(&a), std::size(origin));
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, BIG_SIZE - i);
+  }
+  EXPECT_TRUE(array_sync(&a));
+  array_destroy(&a);
 
-  array_pop_back(&a);
+  EXPECT_EQ(file_size(path), static_cast<long>(BIG_SIZE * sizeof(int)));
 
-  EXPECT_EQ(array_size(&a), std::size(origin) - 1);
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), 0));
+  EXPECT_EQ(array_size(&a), static_cast<std::size_t>(BIG_SIZE));
+  array_quick_sort(&a);
+  array_insert(&a, 0, 0);
+  array_destroy(&a);
 
-  for (std::size_t i = 0; i < std::size(origin) - 1; ++i) {
-    EXPECT_EQ(array_get(&a, i), origin[i]);
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), ARRAY_MMAP_READ_ONLY));
+  EXPECT_EQ(array_size(&a), static_cast<std::size_t>(BIG_SIZE + 1));
+  EXPECT_TRUE(array_is_sorted(&a));
+  for (int i = 0; i <= BIG_SIZE; ++i) {
+    EXPECT_EQ(array_search_sorted(&a, i), static_cast<std::size_t>(i));
   }
-
   array_destroy(&a);
+
+  std::remove(path.c_str());
 }
 
-TEST(ArrayPopBackTest, ManyElements) {
-  static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+TEST(ArrayOpenMmapTest, NotExisting) {
+  std::string path = temp_path("array_mmap_missing.bin");
 
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  EXPECT_FALSE(array_open_mmap(&a, path.c_str(), 0));
+}
 
-  EXPECT_EQ(array_size(&a), std::size(origin));
+TEST(ArrayOpenMmapTest, MoveAndShrink) {
+  std::string path = temp_path("array_mmap_move.bin");
 
-  for (std::size_t i = 0; i < std::size(origin); ++i) {
-    array_pop_back(&a);
+  struct array a;
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), ARRAY_MMAP_CREATE));
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
   }
+  array_radix_sort(&a);
 
-  EXPECT_TRUE(array_empty(&a));
-  EXPECT_EQ(array_size(&a), 0u);
-
+  struct array b;
+  array_move(&b, &a);
+  array_push_back(&a, 1);
   array_destroy(&a);
-}
 
-/*
- * array_insert
- */
+  array_erase_range(&b, 3, BIG_SIZE);
+  array_shrink_to_fit(&b);
+  EXPECT_EQ(b.capacity, 3u);
+  array_destroy(&b);
 
-TEST(ArrayInsertTest, Beginning) {
-  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
-  static const int expected[] = { 42, 9, 3, 7, 2, 4, 0, 8 };
+  EXPECT_EQ(file_size(path), static_cast<long>(3 * sizeof(int)));
 
-  struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  std::remove(path.c_str());
+}
 
-  array_insert(&a, 42, 0); // insert at the beginning
+TEST(ArrayOpenMmapTest, PartialElement) {
+  std::string path = temp_path("array_mmap_partial.bin");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  static const char bytes[7] = { 1, 2, 3, 4, 5, 6, 7 };
+  EXPECT_EQ(write(fd, bytes, sizeof(bytes)), static_cast<ssize_t>(sizeof(bytes)));
+  close(fd);
 
-  EXPECT_EQ(array_size(&a), std::size(expected));
-  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+  struct array a;
+  errno = 0;
+  EXPECT_FALSE(array_open_mmap(&a, path.c_str(), 0));
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(file_size(path), 7);
 
-  array_destroy(&a);
+  std::remove(path.c_str());
 }
 
-TEST(ArrayInsertTest, Middle) {
-  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
-  static const int expected[] = { 9, 3, 7, 42, 2, 4, 0, 8 };
+TEST(ArrayOpenMmapTest, RemovedStayRemoved) {
+  std::string path = temp_path("array_mmap_removed.bin");
 
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), ARRAY_MMAP_CREATE));
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
+  }
+  array_destroy(&a);
 
-  array_insert(&a, 42, 3); // insert in the middle
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), 0));
+  array_erase_range(&a, 10, BIG_SIZE - 10);
+  array_pop_back(&a);
+  array_destroy(&a);
 
-  EXPECT_EQ(array_size(&a), std::size(expected));
-  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), 0));
+  EXPECT_EQ(array_size(&a), 19u);
+  EXPECT_EQ(array_get(&a, 10), BIG_SIZE - 10);
+  EXPECT_EQ(array_get(&a, 18), BIG_SIZE - 2);
+  array_clear(&a);
+  array_destroy(&a);
 
+  EXPECT_EQ(file_size(path), 0);
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), 0));
+  EXPECT_TRUE(array_empty(&a));
   array_destroy(&a);
+
+  std::remove(path.c_str());
 }
 
-TEST(ArrayInsertTest, End) {
-  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
-  static const int expected[] = { 9, 3, 7, 2, 4, 0, 8, 42 };
+TEST(ArrayOpenMmapTest, DestroyWithPendingRemovals) {
+  std::string path = temp_path("array_mmap_tombstones.bin");
 
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
-
-  array_insert(&a, 42, std::size(origin)); // insert at the end
-
-  EXPECT_EQ(array_size(&a), std::size(expected));
-  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), ARRAY_MMAP_CREATE));
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
+  }
+  array_set_storage(&a, ARRAY_STORAGE_TOMBSTONES);
+  array_remove(&a, 0);
+  array_remove(&a, 10);
+  ASSERT_NE(a.dead, 0u);
+  array_destroy(&a);
 
+  EXPECT_EQ(file_size(path), (long)((BIG_SIZE - 2) * sizeof(int)));
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), 0));
+  EXPECT_EQ(array_size(&a), (size_t)(BIG_SIZE - 2));
+  EXPECT_EQ(array_get(&a, 0), 1);
+  EXPECT_EQ(array_get(&a, 10), 12);
+  EXPECT_EQ(array_get(&a, BIG_SIZE - 3), BIG_SIZE - 1);
   array_destroy(&a);
+
+  std::remove(path.c_str());
 }
 
-TEST(ArrayInsertTest, Stressed) {
-  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+TEST(ArrayOpenMmapTest, SyncTrimsTheFile) {
+  std::string path = temp_path("array_mmap_sync.bin");
 
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), ARRAY_MMAP_CREATE));
+  EXPECT_TRUE(array_sync(&a));
+  EXPECT_EQ(file_size(path), 0);
 
-  for (int i = 0; i < BIG_SIZE; ++i) {
-    array_insert(&a, i + 1, 4);
-    EXPECT_EQ(array_size(&a), std::size(origin) + i + 1);
+  for (int i = 0; i < 3; ++i) {
+    array_push_back(&a, i);
   }
+  EXPECT_TRUE(array_sync(&a));
+  EXPECT_EQ(file_size(path), static_cast<long>(3 * sizeof(int)));
 
+  for (int i = 3; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
+  }
+  array_erase_range(&a, 5, BIG_SIZE);
+  EXPECT_TRUE(array_sync(&a));
+  EXPECT_EQ(file_size(path), static_cast<long>(5 * sizeof(int)));
+
+  // what a reader sees if the program stops right after the sync
+  struct array b;
+  ASSERT_TRUE(array_open_mmap(&b, path.c_str(), ARRAY_MMAP_READ_ONLY));
+  EXPECT_EQ(array_size(&b), 5u);
+  EXPECT_EQ(array_get(&b, 4), 4);
+  array_destroy(&b);
+
+  array_push_back(&a, 5);
+  array_clear(&a);
+  EXPECT_TRUE(array_sync(&a));
+  EXPECT_EQ(file_size(path), 0);
+  array_push_back(&a, 7);
+  array_destroy(&a);
+
+  EXPECT_EQ(file_size(path), static_cast<long>(sizeof(int)));
+  ASSERT_TRUE(array_open_mmap(&a, path.c_str(), 0));
+  EXPECT_EQ(array_size(&a), 1u);
+  EXPECT_EQ(array_get(&a, 0), 7);
   array_destroy(&a);
-}
 
+  std::remove(path.c_str());
+}
 
 /*
- * array_remove
+ * array_save / array_load
  */
 
-TEST(ArrayRemoveTest, Beginning) {
-  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
-  static const int expected[] = { 3, 7, 2, 4, 0, 8 };
+static long save_and_load(const struct array *a, unsigned flags, struct array *b) {
+  std::string path = temp_path("array_save.bin");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  EXPECT_TRUE(array_save(a, fd, flags));
+  long bytes = lseek(fd, 0, SEEK_CUR);
+  lseek(fd, 0, SEEK_SET);
+
+  array_create(b);
+  EXPECT_TRUE(array_load(b, fd));
+  close(fd);
+  std::remove(path.c_str());
+  return bytes;
+}
 
+TEST(ArraySaveLoadTest, Raw) {
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  array_create(&a);
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, (i % 2 == 0) ? i * 7919 : -i);
+  }
 
-  array_remove(&a, 0); // remove at the beginning
+  struct array b;
+  long bytes = save_and_load(&a, 0, &b);
 
-  EXPECT_EQ(array_size(&a), std::size(expected));
-  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+  EXPECT_EQ(bytes, static_cast<long>(32 + BIG_SIZE * sizeof(int)));
+  EXPECT_TRUE(array_equals(&b, a.data, a.size));
 
+  array_destroy(&b);
   array_destroy(&a);
 }
 
-TEST(ArrayRemoveTest, Middle) {
-  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
-  static const int expected[] = { 9, 3, 7, 4, 0, 8 };
-
+TEST(ArraySaveLoadTest, DeltaVarint) {
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  array_create(&a);
+  array_push_back(&a, INT_MIN);
+  for (int i = 0; i < 100 * BIG_SIZE; ++i) {
+    array_push_back(&a, -50 * BIG_SIZE + i * 3);
+  }
+  array_push_back(&a, INT_MAX);
 
-  array_remove(&a, 3); // remove in the middle
+  struct array b;
+  long bytes = save_and_load(&a, ARRAY_SAVE_DELTA_VARINT, &b);
 
-  EXPECT_EQ(array_size(&a), std::size(expected));
-  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+  EXPECT_LT(bytes, static_cast<long>(32 + 100 * BIG_SIZE + 20));
+  EXPECT_TRUE(array_equals(&b, a.data, a.size));
 
+  array_destroy(&b);
   array_destroy(&a);
 }
 
-TEST(ArrayRemoveTest, End) {
+TEST(ArraySaveLoadTest, DeltaVarintNotSorted) {
   static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
-  static const int expected[] = { 9, 3, 7, 2, 4, 0 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  array_remove(&a, std::size(origin) - 1); // remove at the end
+  struct array b;
+  long bytes = save_and_load(&a, ARRAY_SAVE_DELTA_VARINT, &b);
 
-  EXPECT_EQ(array_size(&a), std::size(expected));
-  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+  EXPECT_EQ(bytes, static_cast<long>(32 + std::size(origin) * sizeof(int)));
+  EXPECT_TRUE(array_equals(&b, origin, std::size(origin)));
 
+  array_destroy(&b);
   array_destroy(&a);
 }
 
-/*
- * array_get
- */
-
-TEST(ArrayGetTest, ValidIndex) {
-  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+TEST(ArraySaveLoadTest, Corrupted) {
+  static const int origin[] = { 1, 2, 3, 5, 6, 7, 8, 9 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  for (std::size_t i = 0; i < std::size(origin); ++i) {
-    EXPECT_EQ(array_get(&a, i), origin[i]);
+  for (unsigned flags : { 0u, static_cast<unsigned>(ARRAY_SAVE_DELTA_VARINT) }) {
+    std::string path = temp_path("array_corrupted.bin");
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    EXPECT_TRUE(array_save(&a, fd, flags));
+    unsigned char byte = 0x7F;
+    EXPECT_EQ(pwrite(fd, &byte, 1, 34), 1);
+    lseek(fd, 0, SEEK_SET);
+
+    struct array b;
+    array_create(&b);
+    EXPECT_FALSE(array_load(&b, fd));
+    EXPECT_TRUE(array_empty(&b));
+    array_destroy(&b);
+
+    close(fd);
+    std::remove(path.c_str());
   }
 
   array_destroy(&a);
 }
 
-TEST(ArrayGetTest, NotValidIndex) {
-  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+TEST(ArraySaveLoadTest, SortedFlagNotTrusted) {
+  static const int origin[] = { 4, 3, 2, 1 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
+  std::string path = temp_path("array_sorted_flag.bin");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  EXPECT_TRUE(array_save(&a, fd, 0));
+  unsigned char flags = 0x01; // sorted
+  EXPECT_EQ(pwrite(fd, &flags, 1, 7), 1);
+  lseek(fd, 0, SEEK_SET);
+
+  struct array b;
+  array_create(&b);
+  array_cache_sorted(&b, true);
+  EXPECT_TRUE(array_load(&b, fd));
+  EXPECT_TRUE(array_equals(&b, origin, std::size(origin)));
+  EXPECT_FALSE(array_is_sorted(&b));
+  array_destroy(&b);
+
+  close(fd);
+  std::remove(path.c_str());
+  array_destroy(&a);
+}
 
-  EXPECT_EQ(array_get(&a, std::size(origin)), 0);
-  EXPECT_EQ(array_get(&a, -1), 0);
+TEST(ArraySaveLoadTest, NotAnArray) {
+  std::string path = temp_path("array_not_an_array.bin");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  static const char text[] = "this is not an array, just some text that is long enough";
+  EXPECT_EQ(write(fd, text, sizeof(text)), static_cast<ssize_t>(sizeof(text)));
+  lseek(fd, 0, SEEK_SET);
 
-  array_destroy(&a);
+  struct array b;
+  array_create(&b);
+  EXPECT_FALSE(array_load(&b, fd));
+  array_destroy(&b);
+
+  close(fd);
+  std::remove(path.c_str());
 }
 
 /*
- * array_set
+ * array_equals
  */
 
-TEST(ArraySetTest, ValidIndex) {
-  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+TEST(ArrayEqualsTest, DifferentElement) {
+  static const int origin[]    = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+  static const int reference[] = { 1, 2, 3, 4, 5, 6, 7, 8, 10 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  for (std::size_t i = 0; i < std::size(origin); ++i) {
-    array_set(&a, i, origin[i] - 1);
-    EXPECT_EQ(array_get(&a, i), origin[i] - 1);
-  }
-
-  EXPECT_EQ(array_size(&a), std::size(origin));
+  EXPECT_FALSE(array_equals(&a, reference, std::size(reference)));
 
   array_destroy(&a);
 }
 
-TEST(ArraySetTest, NotValidIndex) {
-  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+TEST(ArrayEqualsTest, SizeShorter) {
+  static const int origin[]    = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+  static const int reference[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  array_set(&a, std::size(origin), 42);
-  array_set(&a, -1, 42);
+  EXPECT_FALSE(array_equals(&a, reference, std::size(reference)));
 
-  EXPECT_EQ(array_size(&a), std::size(origin));
+  array_destroy(&a);
+}
 
-  for (std::size_t i = 0; i < std::size(origin); ++i) {
-    EXPECT_EQ(array_get(&a, i), origin[i]);
-  }
+TEST(ArrayEqualsTest, SizeLarger) {
+  static const int origin[]    = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+  static const int reference[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_FALSE(array_equals(&a, reference, std::size(reference)));
 
   array_destroy(&a);
 }
 
 /*
- * array_search
+ * array_push_back
  */
 
-TEST(ArraySearchTest, Present) {
-  static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
-
+TEST(ArrayPushBackTest, OneElement) {
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  array_create(&a);
+  array_push_back(&a, 1);
 
-  for (size_t i = 0; i < std::size(origin); ++i) {
-    size_t index = array_search(&a, origin[i]);
-    EXPECT_EQ(index, i);
-  }
+  EXPECT_FALSE(array_empty(&a));
+  EXPECT_TRUE(array_size(&a) == 1);
+  EXPECT_EQ(array_get(&a, 0), 1);
 
   array_destroy(&a);
 }
 
-TEST(ArraySearchTest, NotPresent) {
+TEST(ArrayPushBackTest, ManyElements) {
   static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
 
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
-
-  size_t index = array_search(&a, -1);
-  EXPECT_EQ(index, std::size(origin));
-
-  array_destroy(&a);
-}
+  array_create(&a);
 
-/*
- * array_search_sorted
- */
+  for (size_t i = 0; i < std::size(origin); ++i) {
+    array_push_back(&a, origin[i]);
+  }
 
-TEST(ArraySearchSortedTest, Present) {
-  static const int origin[] = { 1, 2, 3, 5, 6, 7, 8, 9 };
+  EXPECT_FALSE(array_empty(&a));
+  EXPECT_EQ(array_size(&a), std::size(origin));
 
-  struct array a;
-  array_create_from(&a, origin, std::size(origin));
 
   for (size_t i = 0; i < std::size(origin); ++i) {
-    size_t index = array_search_sorted(&a, origin[i]);
-    EXPECT_EQ(index, i);
+    EXPECT_EQ(array_get(&a, i), origin[i]);
   }
 
+  EXPECT_TRUE(array_equals(&a, origin, std::size(origin)));
+
   array_destroy(&a);
 }
 
+TEST(ArrayPushBackTest, Stressed) {
+  struct array a;
 
-TEST(ArraySearchSortedTest, NotPresentBefore) {
-  static const int origin[] = { 1, 2, 3, 5, 6, 7, 8, 9 };
+  array_create(&a);
 
-  struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i + 1);
+    EXPECT_EQ(array_size(&a), static_cast<std::size_t>(i + 1));
+  }
 
-  size_t index = array_search_sorted(&a, -1); // before everything
-  EXPECT_EQ(index, std::size(origin));
+  EXPECT_FALSE(array_empty(&a));
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    EXPECT_EQ(array_get(&a, i), i + 1);
+  }
 
   array_destroy(&a);
 }
 
-TEST(ArraySearchSortedTest, NotPresentAfter) {
-  static const int origin[] = { 1, 2, 3, 5, 6, 7, 8, 9 };
+/*
+ * array_set_growth
+ */
 
+TEST(ArraySetGrowthTest, Half) {
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  array_create(&a);
+  array_set_growth(&a, ARRAY_GROWTH_HALF, 0);
 
-  size_t index = array_search_sorted(&a, 15); // after everything
-  EXPECT_EQ(index, std::size(origin));
+  std::size_t capacity = a.capacity;
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
+    if (a.capacity != capacity) {
+      EXPECT_EQ(a.capacity, capacity + capacity / 2);
+      capacity = a.capacity;
+    }
+  }
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    EXPECT_EQ(array_get(&a, i), i);
+  }
 
   array_destroy(&a);
 }
 
-TEST(ArraySearchSortedTest, NotPresentMiddle) {
-  static const int origin[] = { 1, 2, 3, 5, 6, 7, 8, 9 };
-
+TEST(ArraySetGrowthTest, Chunk) {
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  array_create(&a);
+  array_set_growth(&a, ARRAY_GROWTH_CHUNK, 64);
 
-  size_t index = array_search_sorted(&a, 4); // in the middle of other elements
-  EXPECT_EQ(index, std::size(origin));
+  std::size_t capacity = a.capacity;
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
+    if (a.capacity != capacity) {
+      EXPECT_EQ(a.capacity, capacity + 64);
+      capacity = a.capacity;
+    }
+  }
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    EXPECT_EQ(array_get(&a, i), i);
+  }
 
   array_destroy(&a);
 }
 
 /*
- * array_is_sorted
+ * small buffer
  */
 
-TEST(ArrayIsSortedTest, Empty) {
+TEST(ArraySmallBufferTest, Inline) {
   struct array a;
   array_create(&a);
 
-  EXPECT_TRUE(array_is_sorted(&a));
+  for (int i = 0; i < ARRAY_INLINE_CAPACITY; ++i) {
+    array_push_back(&a, i);
+  }
+
+  EXPECT_EQ(a.data, a.inline_data);
+  for (int i = 0; i < ARRAY_INLINE_CAPACITY; ++i) {
+    EXPECT_EQ(array_get(&a, i), i);
+  }
 
   array_destroy(&a);
 }
 
-TEST(ArrayIsSortedTest, Sorted) {
-  static const int origin[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
-
+TEST(ArraySmallBufferTest, Spill) {
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
-
-  EXPECT_TRUE(array_is_sorted(&a));
+  array_create(&a);
 
-  array_destroy(&a);
-}
+  for (int i = 0; i < ARRAY_INLINE_CAPACITY; ++i) {
+    array_push_back(&a, i);
+  }
+  array_insert(&a, 42, 0);
 
-TEST(ArrayIsSortedTest, NotSorted) {
-  static const int origin[] = { 0, 1, 2, 3, 4, 5, 10, 9, 8, 7, 6 };
+  EXPECT_NE(a.data, a.inline_data);
+  EXPECT_EQ(array_size(&a), static_cast<std::size_t>(ARRAY_INLINE_CAPACITY + 1));
+  EXPECT_EQ(array_get(&a, 0), 42);
+  for (int i = 0; i < ARRAY_INLINE_CAPACITY; ++i) {
+    EXPECT_EQ(array_get(&a, i + 1), i);
+  }
 
-  struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  array_remove(&a, 0);
+  array_shrink_to_fit(&a);
 
-  EXPECT_FALSE(array_is_sorted(&a));
+  EXPECT_EQ(a.data, a.inline_data);
+  for (int i = 0; i < ARRAY_INLINE_CAPACITY; ++i) {
+    EXPECT_EQ(array_get(&a, i), i);
+  }
 
   array_destroy(&a);
 }
 
-TEST(ArrayIsSortedTest, NotSortedAtTheEnd) {
-  static const int origin[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0 };
+TEST(ArraySmallBufferTest, CreateFrom) {
+  static const int small[] = { 1, 2, 3 };
+  static const int big[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
 
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
-
-  EXPECT_FALSE(array_is_sorted(&a));
+  array_create_from(&a, small, std::size(small));
+  EXPECT_EQ(a.data, a.inline_data);
+  EXPECT_TRUE(array_equals(&a, small, std::size(small)));
+  array_destroy(&a);
 
+  array_create_from(&a, big, std::size(big));
+  EXPECT_NE(a.data, a.inline_data);
+  EXPECT_TRUE(array_equals(&a, big, std::size(big)));
   array_destroy(&a);
 }
 
 /*
- * array_partition
+ * array_reserve
  */
 
-TEST(ArrayPartitionTest, WholeSorted) {
-  static const int origin[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+TEST(ArrayReserveTest, Grow) {
+  static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  ptrdiff_t p = array_partition(&a, 0, std::size(origin) - 1);
-  int pivot = array_get(&a, p);
-
-  for (ptrdiff_t i = 0; i < p; ++i) {
-    EXPECT_LT(array_get(&a, i), pivot);
-  }
-
-  for (ptrdiff_t i = p + 1; i < static_cast<ptrdiff_t>(std::size(origin)); ++i) {
-    EXPECT_GT(array_get(&a, i), pivot);
-  }
+  EXPECT_TRUE(array_reserve(&a, BIG_SIZE));
+  EXPECT_GE(a.capacity, static_cast<std::size_t>(BIG_SIZE));
+  EXPECT_TRUE(array_equals(&a, origin, std::size(origin)));
 
-  for (int val : origin) {
-    EXPECT_NE(array_search(&a, val), std::size(origin));
+  int *data = a.data;
+  for (int i = std::size(origin); i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
   }
+  EXPECT_EQ(a.data, data);
 
   array_destroy(&a);
 }
 
-TEST(ArrayPartitionTest, WholeNotSorted) {
-  static const int origin[] = { 5, 4, 1, 6, 10, 3, 0, 9, 8, 2, 7 };
+TEST(ArrayReserveTest, Smaller) {
+  static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  ptrdiff_t p = array_partition(&a, 0, std::size(origin) - 1);
-  int pivot = array_get(&a, p);
-
-  for (ptrdiff_t i = 0; i < p; ++i) {
-    EXPECT_LT(array_get(&a, i), pivot);
-  }
-
-  for (ptrdiff_t i = p + 1; i < static_cast<ptrdiff_t>(std::size(origin)); ++i) {
-    EXPECT_GT(array_get(&a, i), pivot);
-  }
-
-  for (int val : origin) {
-    EXPECT_NE(array_search(&a, val), std::size(origin));
-  }
+  std::size_t capacity = a.capacity;
+  EXPECT_TRUE(array_reserve(&a, 1));
+  EXPECT_EQ(a.capacity, capacity);
+  EXPECT_TRUE(array_equals(&a, origin, std::size(origin)));
 
   array_destroy(&a);
 }
 
-TEST(ArrayPartitionTest, PartNotSorted) {
-  static const int origin[] = { 5, 4, 1, 6, 10, 3, 0, 9, 8, 2, 7 };
+/*
+ * array_shrink_to_fit
+ */
+
+TEST(ArrayShrinkToFitTest, ManyElements) {
+  static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  ptrdiff_t p = array_partition(&a, 3, 8);
-  int pivot = array_get(&a, p);
-
-  for (ptrdiff_t i = 3; i < p; ++i) {
-    EXPECT_LT(array_get(&a, i), pivot);
-  }
+  array_shrink_to_fit(&a);
 
-  for (ptrdiff_t i = p + 1; i < 8; ++i) {
-    EXPECT_GT(array_get(&a, i), pivot);
-  }
+  EXPECT_EQ(a.capacity, std::size(origin));
+  EXPECT_TRUE(array_equals(&a, origin, std::size(origin)));
 
-  for (int val : origin) {
-    EXPECT_NE(array_search(&a, val), std::size(origin));
-  }
+  array_push_back(&a, 10);
+  EXPECT_EQ(array_get(&a, std::size(origin)), 10);
 
   array_destroy(&a);
 }
 
-TEST(ArrayPartitionTest, Single) {
-  static const int origin[] = { 5, 4, 1, 6, 10, 3, 0, 9, 8, 2, 7 };
-
+TEST(ArrayShrinkToFitTest, Empty) {
   struct array a;
-  array_create_from(&a, origin, std::size(origin));
+  array_create(&a);
 
-  ptrdiff_t p = array_partition(&a, 5, 5);
+  array_shrink_to_fit(&a);
 
-  EXPECT_EQ(p, 5);
+  EXPECT_EQ(a.capacity, static_cast<std::size_t>(ARRAY_INLINE_CAPACITY));
+  EXPECT_EQ(a.data, a.inline_data);
+  EXPECT_TRUE(array_empty(&a));
 
-  for (int val : origin) {
-    EXPECT_NE(array_search(&a, val), std::size(origin));
-  }
+  array_push_back(&a, 1);
+  EXPECT_EQ(array_get(&a, 0), 1);
 
   array_destroy(&a);
 }
 
 /*
- * array_quick_sort
+ * array_pop_back
  */
 
-TEST(ArrayQuickSortTest, NotSorted) {
-  static const int origin[] = { 8, 4, 1, 6, 10, 3, 0, 9, 5, 2, 7 };
+TEST(ArrayPopBackTest, OneElement) {
+  static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  EXPECT_FALSE(array_is_sorted(&a));
+  EXPECT_EQ(array_size(&a), std::size(origin));
 
-  array_quick_sort(&a);
+  array_pop_back(&a);
 
-  EXPECT_TRUE(array_is_sorted(&a));
+  EXPECT_EQ(array_size(&a), std::size(origin) - 1);
 
-  for (int val : origin) {
-    EXPECT_NE(array_search(&a, val), std::size(origin));
+  for (std::size_t i = 0; i < std::size(origin) - 1; ++i) {
+    EXPECT_EQ(array_get(&a, i), origin[i]);
   }
 
   array_destroy(&a);
 }
 
-TEST(ArrayQuickSortTest, SortedBackward) {
-  static const int origin[] = { 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+TEST(ArrayPopBackTest, ManyElements) {
+  static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  EXPECT_FALSE(array_is_sorted(&a));
-
-  array_quick_sort(&a);
-
-  EXPECT_TRUE(array_is_sorted(&a));
+  EXPECT_EQ(array_size(&a), std::size(origin));
 
-  for (int val : origin) {
-    EXPECT_NE(array_search(&a, val), std::size(origin));
+  for (std::size_t i = 0; i < std::size(origin); ++i) {
+    array_pop_back(&a);
   }
 
-  array_destroy(&a);
-}
-
-TEST(ArrayQuickSortTest, Sorted) {
-  static const int origin[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
-
-  struct array a;
-  array_create_from(&a, origin, std::size(origin));
-
-  EXPECT_TRUE(array_is_sorted(&a));
-
-  array_quick_sort(&a);
-
-  EXPECT_TRUE(array_is_sorted(&a));
-
-  for (int val : origin) {
-    EXPECT_NE(array_search(&a, val), std::size(origin));
-  }
+  EXPECT_TRUE(array_empty(&a));
+  EXPECT_EQ(array_size(&a), 0u);
 
   array_destroy(&a);
 }
 
 /*
- * array_heap_sort
+ * array_insert
  */
 
-TEST(ArrayHeapSortTest, NotSorted) {
-  static const int origin[] = { 8, 4, 1, 6, 10, 3, 0, 9, 5, 2, 7 };
+TEST(ArrayInsertTest, Beginning) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+  static const int expected[] = { 42, 9, 3, 7, 2, 4, 0, 8 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  EXPECT_FALSE(array_is_sorted(&a));
-
-  array_heap_sort(&a);
-
-  EXPECT_TRUE(array_is_sorted(&a));
+  array_insert(&a, 42, 0); // insert at the beginning
 
-  for (int val : origin) {
-    EXPECT_NE(array_search(&a, val), std::size(origin));
-  }
+  EXPECT_EQ(array_size(&a), std::size(expected));
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
 
   array_destroy(&a);
 }
 
-TEST(ArrayHeapSortTest, SortedBackward) {
-  static const int origin[] = { 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+TEST(ArrayInsertTest, Middle) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+  static const int expected[] = { 9, 3, 7, 42, 2, 4, 0, 8 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  EXPECT_FALSE(array_is_sorted(&a));
+  array_insert(&a, 42, 3); // insert in the middle
 
-  array_heap_sort(&a);
+  EXPECT_EQ(array_size(&a), std::size(expected));
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
 
-  EXPECT_TRUE(array_is_sorted(&a));
+  array_destroy(&a);
+}
 
-  for (int val : origin) {
-    EXPECT_NE(array_search(&a, val), std::size(origin));
+TEST(ArrayInsertTest, End) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+  static const int expected[] = { 9, 3, 7, 2, 4, 0, 8, 42 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_insert(&a, 42, std::size(origin)); // insert at the end
+
+  EXPECT_EQ(array_size(&a), std::size(expected));
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayInsertTest, Stressed) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_insert(&a, i + 1, 4);
+    EXPECT_EQ(array_size(&a), std::size(origin) + i + 1);
   }
 
   array_destroy(&a);
 }
 
-TEST(ArrayHeapSortTest, Sorted) {
-  static const int origin[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+/*
+ * array_remove
+ */
+
+TEST(ArrayRemoveTest, Beginning) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+  static const int expected[] = { 3, 7, 2, 4, 0, 8 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  EXPECT_TRUE(array_is_sorted(&a));
+  array_remove(&a, 0); // remove at the beginning
 
-  array_heap_sort(&a);
+  EXPECT_EQ(array_size(&a), std::size(expected));
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
 
-  EXPECT_TRUE(array_is_sorted(&a));
+  array_destroy(&a);
+}
 
-  for (int val : origin) {
-    EXPECT_NE(array_search(&a, val), std::size(origin));
-  }
+TEST(ArrayRemoveTest, Middle) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+  static const int expected[] = { 9, 3, 7, 4, 0, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_remove(&a, 3); // remove in the middle
+
+  EXPECT_EQ(array_size(&a), std::size(expected));
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayRemoveTest, End) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+  static const int expected[] = { 9, 3, 7, 2, 4, 0 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_remove(&a, std::size(origin) - 1); // remove at the end
+
+  EXPECT_EQ(array_size(&a), std::size(expected));
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
 
   array_destroy(&a);
 }
 
 /*
- * array_is_heap
+ * array_append_range
  */
 
-TEST(ArrayIsHeapTest, Empty) {
+TEST(ArrayAppendRangeTest, ManyElements) {
+  static const int origin[] = { 9, 3, 7 };
+  static const int other[] = { 2, 4, 0, 8 };
+  static const int expected[] = { 9, 3, 7, 2, 4, 0, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_append_range(&a, other, std::size(other));
+
+  EXPECT_EQ(array_size(&a), std::size(expected));
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayAppendRangeTest, Stressed) {
+  int origin[BIG_SIZE];
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    origin[i] = i;
+  }
+
   struct array a;
   array_create(&a);
 
-  EXPECT_TRUE(array_is_heap(&a));
+  array_append_range(&a, origin, BIG_SIZE);
+
+  EXPECT_EQ(array_size(&a), static_cast<std::size_t>(BIG_SIZE));
+  EXPECT_TRUE(array_equals(&a, origin, BIG_SIZE));
 
   array_destroy(&a);
 }
 
-TEST(ArrayIsHeapTest, SimpleHeap1) {
-  static const int origin[] = { 13, 6, 8, 5, 3 };
+/*
+ * array_insert_range
+ */
+
+TEST(ArrayInsertRangeTest, Beginning) {
+  static const int origin[] = { 9, 3, 7, 2 };
+  static const int other[] = { 42, 43, 44 };
+  static const int expected[] = { 42, 43, 44, 9, 3, 7, 2 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  EXPECT_TRUE(array_is_heap(&a));
+  array_insert_range(&a, 0, other, std::size(other));
+
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
 
   array_destroy(&a);
 }
 
-TEST(ArrayIsHeapTest, SimpleHeap2) {
-  static const int origin[] = { 81, 45, 24, 21, 6, 17, 19, 14 };
+TEST(ArrayInsertRangeTest, Middle) {
+  static const int origin[] = { 9, 3, 7, 2 };
+  static const int other[] = { 42, 43, 44, 45, 46, 47, 48, 49, 50 };
+  static const int expected[] = { 9, 3, 42, 43, 44, 45, 46, 47, 48, 49, 50, 7, 2 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  EXPECT_TRUE(array_is_heap(&a));
+  array_insert_range(&a, 2, other, std::size(other));
+
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
 
   array_destroy(&a);
 }
 
-TEST(ArrayIsHeapTest, NotHeap1) {
-  static const int origin[] = { 6, 5, 4, 3, 1, 8 };
+TEST(ArrayInsertRangeTest, End) {
+  static const int origin[] = { 9, 3, 7, 2 };
+  static const int other[] = { 42, 43 };
+  static const int expected[] = { 9, 3, 7, 2, 42, 43 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  EXPECT_FALSE(array_is_heap(&a));
+  array_insert_range(&a, std::size(origin), other, std::size(other));
+
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
 
   array_destroy(&a);
 }
 
-TEST(ArrayIsHeapTest, NotHeap2) {
-  static const int origin[] = { 6, 5, 4, 3, 1, 0, 8 };
+TEST(ArrayInsertRangeTest, NotValidIndex) {
+  static const int origin[] = { 9, 3, 7, 2 };
+  static const int other[] = { 42, 43 };
 
   struct array a;
   array_create_from(&a, origin, std::size(origin));
 
-  EXPECT_FALSE(array_is_heap(&a));
+  array_insert_range(&a, std::size(origin) + 1, other, std::size(other));
+
+  EXPECT_TRUE(array_equals(&a, origin, std::size(origin)));
 
   array_destroy(&a);
 }
 
 /*
- * array_heap_add
+ * array_erase_range
  */
 
-TEST(ArrayHeapAddTest, Stressed) {
+TEST(ArrayEraseRangeTest, Beginning) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+  static const int expected[] = { 2, 4, 0, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_erase_range(&a, 0, 3);
+
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayEraseRangeTest, Middle) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+  static const int expected[] = { 9, 3, 0, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_erase_range(&a, 2, 5);
+
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayEraseRangeTest, End) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+  static const int expected[] = { 9, 3, 7 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_erase_range(&a, 3, std::size(origin));
+
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayEraseRangeTest, NotValidRange) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_erase_range(&a, 4, 2);
+  array_erase_range(&a, 2, std::size(origin) + 1);
+
+  EXPECT_TRUE(array_equals(&a, origin, std::size(origin)));
+
+  array_destroy(&a);
+}
+
+/*
+ * array_set_storage
+ */
+
+TEST(ArraySetStorageTest, GapBufferInsertRemove) {
+  static const int expected[] = { 0, 10, 1, 2, 11, 3, 4 };
+
   struct array a;
+  array_create(&a);
+  array_set_storage(&a, ARRAY_STORAGE_GAP_BUFFER);
+  for (int i = 0; i < 5; ++i) {
+    array_push_back(&a, i);
+  }
+
+  array_insert(&a, 10, 1);
+  array_insert(&a, 11, 4);
+  array_insert(&a, 12, 5);
+  array_remove(&a, 5);
+
+  ASSERT_EQ(array_size(&a), std::size(expected));
+  for (std::size_t i = 0; i < std::size(expected); ++i) {
+    EXPECT_EQ(array_get(&a, i), expected[i]);
+  }
+  EXPECT_NE(a.gap_size, 0u);
+  std::size_t gap_size = a.gap_size;
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+  EXPECT_EQ(a.gap_size, gap_size);
+
+  array_destroy(&a);
+}
 
+TEST(ArraySetStorageTest, BackToContiguous) {
+  static const int expected[] = { 1, 0, 2 };
+
+  struct array a;
   array_create(&a);
+  array_set_storage(&a, ARRAY_STORAGE_GAP_BUFFER);
+  array_push_back(&a, 0);
+  array_insert(&a, 1, 0);
+  array_push_back(&a, 2);
 
-  for (int i = 0; i < BIG_SIZE; ++i) {
-    array_heap_add(&a, i);
-    EXPECT_EQ(i, array_heap_top(&a));
-    EXPECT_TRUE(array_is_heap(&a));
+  array_set_storage(&a, ARRAY_STORAGE_CONTIGUOUS);
+
+  EXPECT_EQ(a.gap_size, 0u);
+  EXPECT_TRUE(std::equal(a.data, a.data + 3, expected));
+
+  array_destroy(&a);
+}
+
+TEST(ArraySetStorageTest, PopBackAfterLeavingGapBuffer) {
+  static const int expected[] = { 42, 0, 1, 2, 3 };
+
+  struct array a;
+  array_create(&a);
+  array_set_storage(&a, ARRAY_STORAGE_GAP_BUFFER);
+  for (int i = 0; i < 5; ++i) {
+    array_push_back(&a, i);
   }
+  array_insert(&a, 99, 4);
+  array_remove(&a, 5);
+
+  array_set_storage(&a, ARRAY_STORAGE_CONTIGUOUS);
+  array_pop_back(&a);
+  array_push_back(&a, 7);
+  array_pop_back(&a);
+  array_insert(&a, 42, 0);
+
+  EXPECT_EQ(a.gap_size, 0u);
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+
+  array_destroy(&a);
+}
+
+TEST(ArraySetStorageTest, GapBufferAfterShrinking) {
+  static const int expected[] = { 7, 17, 18, 19 };
+
+  struct array a;
+  array_create(&a);
+  array_set_storage(&a, ARRAY_STORAGE_GAP_BUFFER);
+  for (int i = 0; i < 20; ++i) {
+    array_push_back(&a, i);
+  }
+  array_insert(&a, 99, 10);
+
+  array_set_storage(&a, ARRAY_STORAGE_CONTIGUOUS);
+  array_erase_range(&a, 0, 18);
+  array_shrink_to_fit(&a);
+  array_set_storage(&a, ARRAY_STORAGE_GAP_BUFFER);
+  array_insert(&a, 7, 0);
+
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
 
   array_destroy(&a);
 }
 
 /*
- * array_heap_remove_top
+ * Run the same random edits on the array with the storage and on a vector
  */
-
-TEST(ArrayHeapRemoveTopTest, Stressed) {
+static void check_edits(enum array_storage storage) {
   struct array a;
+  array_create(&a);
+  array_set_storage(&a, storage);
+  std::vector<int> reference;
+
+  // edits around a cursor that wanders, with every operation that works around the gap
+  unsigned seed = 1;
+  std::size_t cursor = 0;
+  for (int step = 0; step < 20 * BIG_SIZE; ++step) {
+    seed = seed * 1103515245u + 12345u;
+    unsigned op = (seed >> 16) % 9;
+    int value = static_cast<int>(seed >> 8);
+    if (cursor > reference.size()) cursor = reference.size();
+    if ((seed >> 4) % 64 == 0) cursor = (seed >> 10) % (reference.size() + 1);
+    std::size_t end = std::min(cursor + 3, reference.size());
+    switch (op) {
+      case 0:
+      case 1:
+        array_insert(&a, value, cursor);
+        reference.insert(reference.begin() + cursor, value);
+        ++cursor;
+        break;
+      case 2:
+        if (cursor < reference.size()) {
+          array_remove(&a, cursor);
+          reference.erase(reference.begin() + cursor);
+        }
+        break;
+      case 3:
+        array_push_back(&a, value);
+        reference.push_back(value);
+        break;
+      case 4:
+        if (!reference.empty()) {
+          array_pop_back(&a);
+          reference.pop_back();
+        }
+        break;
+      case 5: {
+        int values[] = { value, value + 1, value + 2 };
+        array_insert_range(&a, cursor, values, std::size(values));
+        reference.insert(reference.begin() + cursor, values, values + std::size(values));
+        break;
+      }
+      case 6:
+        array_erase_range(&a, cursor, end);
+        reference.erase(reference.begin() + cursor, reference.begin() + end);
+        break;
+      case 7: {
+        int values[] = { value, value - 1 };
+        array_append_range(&a, values, std::size(values));
+        reference.insert(reference.end(), values, values + std::size(values));
+        break;
+      }
+      case 8:
+        if (cursor < reference.size()) {
+          array_set(&a, cursor, value);
+          reference[cursor] = value;
+        }
+        break;
+    }
+    ASSERT_EQ(array_size(&a), reference.size());
+    if (step % 1000 == 0) {
+      for (std::size_t i = 0; i < reference.size(); ++i) {
+        ASSERT_EQ(array_get(&a, i), reference[i]);
+      }
+    }
+  }
+
+  array_quick_sort(&a);
+  std::sort(reference.begin(), reference.end());
+  EXPECT_TRUE(array_equals(&a, reference.data(), reference.size()));
+
+  array_destroy(&a);
+}
+
+TEST(ArraySetStorageTest, GapBufferMatchesVector) {
+  check_edits(ARRAY_STORAGE_GAP_BUFFER);
+}
 
+TEST(ArraySetStorageTest, TombstonesMatchVector) {
+  check_edits(ARRAY_STORAGE_TOMBSTONES);
+}
+
+TEST(ArraySetStorageTest, GapBufferAlgorithmsCloseTheGap) {
+  struct array a, b, out;
   array_create(&a);
+  array_create(&b);
+  array_create(&out);
+  array_set_storage(&a, ARRAY_STORAGE_GAP_BUFFER);
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, 2 * i);
+    array_push_back(&b, 3 * i);
+  }
+  array_remove(&a, 0);
+  array_insert(&a, 0, 0);
 
+  EXPECT_TRUE(array_is_sorted(&a));
+  EXPECT_EQ(array_search_sorted(&a, 500), 250u);
+  array_insert(&a, 1, 1);
+  EXPECT_TRUE(array_set_intersection(&a, &b, &out));
+  EXPECT_EQ(array_get(&out, 1), 6);
+
+  array_destroy(&a);
+  array_destroy(&b);
+  array_destroy(&out);
+}
+
+TEST(ArraySetStorageTest, TombstonesRemoveLazily) {
+  struct array a;
+  array_create(&a);
+  array_set_storage(&a, ARRAY_STORAGE_TOMBSTONES);
   for (int i = 0; i < BIG_SIZE; ++i) {
-    array_heap_add(&a, i);
+    array_push_back(&a, i);
   }
 
-  EXPECT_TRUE(array_is_heap(&a));
+  // every tenth element, from the back so that the indices stay valid
+  for (int i = BIG_SIZE - 10; i >= 0; i -= 10) {
+    array_remove(&a, i);
+  }
+
+  EXPECT_EQ(array_size(&a), static_cast<std::size_t>(BIG_SIZE - BIG_SIZE / 10));
+  EXPECT_EQ(a.dead, static_cast<std::size_t>(BIG_SIZE / 10));
+  for (std::size_t i = 0; i < array_size(&a); ++i) {
+    ASSERT_EQ(array_get(&a, i), static_cast<int>(i + i / 9 + 1));
+  }
+
+  array_compact(&a);
+  EXPECT_EQ(a.dead, 0u);
+  EXPECT_EQ(a.tombstones, nullptr);
+  for (std::size_t i = 0; i < array_size(&a); ++i) {
+    ASSERT_EQ(a.data[i], static_cast<int>(i + i / 9 + 1));
+  }
+
+  array_destroy(&a);
+}
 
+TEST(ArraySetStorageTest, TombstonesCompactAutomatically) {
+  struct array a;
+  array_create(&a);
+  array_set_storage(&a, ARRAY_STORAGE_TOMBSTONES);
   for (int i = 0; i < BIG_SIZE; ++i) {
-    EXPECT_EQ(BIG_SIZE - i - 1, array_heap_top(&a));
-    array_heap_remove_top(&a);
+    array_push_back(&a, i);
   }
 
-  EXPECT_TRUE(array_empty(&a));
+  for (int i = 0; i < BIG_SIZE / 2; ++i) {
+    array_remove(&a, i);
+    EXPECT_LE(a.dead * 4, array_size(&a) + a.dead);
+  }
+
+  EXPECT_EQ(array_size(&a), static_cast<std::size_t>(BIG_SIZE / 2));
+  for (int i = 0; i < BIG_SIZE / 2; ++i) {
+    ASSERT_EQ(array_get(&a, i), 2 * i + 1);
+  }
 
   array_destroy(&a);
 }
 
+TEST(ArraySetStorageTest, TombstonesEraseRangeInOneMove) {
+  struct array a;
+  array_create(&a);
+  array_set_storage(&a, ARRAY_STORAGE_TOMBSTONES);
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
+  }
+  array_remove(&a, 0);
+  array_remove(&a, 0);
+
+  array_erase_range(&a, 8, BIG_SIZE - 10);
+
+  EXPECT_EQ(a.dead, 0u);
+  EXPECT_EQ(a.tombstones, nullptr);
+  EXPECT_EQ(array_size(&a), 16u);
+  for (int i = 0; i < 16; ++i) {
+    ASSERT_EQ(array_get(&a, i), (i < 8) ? i + 2 : BIG_SIZE - 16 + i);
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArraySetStorageTest, ConstFunctionsLeaveLayout) {
+  for (enum array_storage storage : { ARRAY_STORAGE_GAP_BUFFER, ARRAY_STORAGE_TOMBSTONES }) {
+    struct array a;
+    array_create(&a);
+    array_set_storage(&a, storage);
+    std::vector<int> expected;
+    for (int i = 0; i < BIG_SIZE; ++i) {
+      array_push_back(&a, 2 * i);
+      expected.push_back(2 * i);
+    }
+    for (std::size_t i : { 200u, 100u, 3u }) {
+      array_remove(&a, i);
+      expected.erase(expected.begin() + i);
+    }
+    std::size_t gap_size = a.gap_size;
+    std::size_t dead = a.dead;
+    ASSERT_NE(gap_size + dead, 0u);
+
+    const struct array *c = &a;
+    EXPECT_TRUE(array_equals(c, expected.data(), expected.size()));
+    EXPECT_TRUE(array_is_sorted(c));
+    EXPECT_EQ(array_search(c, expected[150]), 150u);
+    EXPECT_EQ(array_search(c, 1), expected.size());
+    EXPECT_EQ(array_lower_bound(c, expected[150]), 150u);
+    EXPECT_EQ(array_upper_bound(c, expected[150]), 151u);
+    EXPECT_EQ(array_search_sorted(c, expected[250]), 250u);
+    EXPECT_FALSE(array_is_heap(c));
+
+    struct array out;
+    array_create(&out);
+    ASSERT_TRUE(array_top_k(c, 3, &out));
+    EXPECT_EQ(array_get(&out, 0), expected.back());
+    struct array other;
+    array_create_from(&other, expected.data(), 10);
+    ASSERT_TRUE(array_set_intersection(c, &other, &out));
+    EXPECT_TRUE(array_equals(&out, expected.data(), 10));
+
+    EXPECT_EQ(a.gap_size, gap_size);
+    EXPECT_EQ(a.dead, dead);
+
+    array_destroy(&other);
+    array_destroy(&out);
+    array_destroy(&a);
+  }
+}
+
+/*
+ * array_get
+ */
+
+TEST(ArrayGetTest, ValidIndex) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  for (std::size_t i = 0; i < std::size(origin); ++i) {
+    EXPECT_EQ(array_get(&a, i), origin[i]);
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayGetTest, NotValidIndex) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_EQ(array_get(&a, std::size(origin)), 0);
+  EXPECT_EQ(array_get(&a, -1), 0);
+
+  array_destroy(&a);
+}
+
+/*
+ * array_set
+ */
+
+TEST(ArraySetTest, ValidIndex) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  for (std::size_t i = 0; i < std::size(origin); ++i) {
+    array_set(&a, i, origin[i] - 1);
+    EXPECT_EQ(array_get(&a, i), origin[i] - 1);
+  }
+
+  EXPECT_EQ(array_size(&a), std::size(origin));
+
+  array_destroy(&a);
+}
+
+TEST(ArraySetTest, NotValidIndex) {
+  static const int origin[] = { 9, 3, 7, 2, 4, 0, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_set(&a, std::size(origin), 42);
+  array_set(&a, -1, 42);
+
+  EXPECT_EQ(array_size(&a), std::size(origin));
+
+  for (std::size_t i = 0; i < std::size(origin); ++i) {
+    EXPECT_EQ(array_get(&a, i), origin[i]);
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArraySetTest, SizeOfFullArray) {
+  // inline buffer and heap buffer, both without a spare slot
+  for (int n : { ARRAY_INLINE_CAPACITY, 2 * ARRAY_INLINE_CAPACITY }) {
+    struct array a;
+    array_create_with_capacity(&a, n);
+    for (int i = 0; i < n; ++i) {
+      array_push_back(&a, i);
+    }
+    ASSERT_EQ(a.size, a.capacity);
+
+    array_set(&a, a.size, 42);
+
+    EXPECT_EQ(array_size(&a), static_cast<std::size_t>(n));
+    EXPECT_EQ(array_get(&a, a.size - 1), n - 1);
+    EXPECT_EQ(array_get(&a, a.size), 0);
+
+    array_destroy(&a);
+  }
+}
+
+/*
+ * array_search
+ */
+
+TEST(ArraySearchTest, Present) {
+  static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  for (size_t i = 0; i < std::size(origin); ++i) {
+    size_t index = array_search(&a, origin[i]);
+    EXPECT_EQ(index, i);
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArraySearchTest, NotPresent) {
+  static const int origin[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  size_t index = array_search(&a, -1);
+  EXPECT_EQ(index, std::size(origin));
+
+  array_destroy(&a);
+}
+
+/*
+ * array_search_sorted
+ */
+
+TEST(ArraySearchSortedTest, Present) {
+  static const int origin[] = { 1, 2, 3, 5, 6, 7, 8, 9 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  for (size_t i = 0; i < std::size(origin); ++i) {
+    size_t index = array_search_sorted(&a, origin[i]);
+    EXPECT_EQ(index, i);
+  }
+
+  array_destroy(&a);
+}
+
+
+TEST(ArraySearchSortedTest, NotPresentBefore) {
+  static const int origin[] = { 1, 2, 3, 5, 6, 7, 8, 9 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  size_t index = array_search_sorted(&a, -1); // before everything
+  EXPECT_EQ(index, std::size(origin));
+
+  array_destroy(&a);
+}
+
+TEST(ArraySearchSortedTest, NotPresentAfter) {
+  static const int origin[] = { 1, 2, 3, 5, 6, 7, 8, 9 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  size_t index = array_search_sorted(&a, 15); // after everything
+  EXPECT_EQ(index, std::size(origin));
+
+  array_destroy(&a);
+}
+
+TEST(ArraySearchSortedTest, NotPresentMiddle) {
+  static const int origin[] = { 1, 2, 3, 5, 6, 7, 8, 9 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  size_t index = array_search_sorted(&a, 4); // in the middle of other elements
+  EXPECT_EQ(index, std::size(origin));
+
+  array_destroy(&a);
+}
+
+TEST(ArraySearchSortedTest, Stressed) {
+  struct array a;
+  array_create(&a);
+
+  for (int i = 0; i < 10 * BIG_SIZE; ++i) {
+    array_push_back(&a, 2 * i);
+  }
+
+  for (int i = 0; i < 10 * BIG_SIZE; ++i) {
+    EXPECT_EQ(array_search_sorted(&a, 2 * i), static_cast<std::size_t>(i));
+    EXPECT_EQ(array_search_sorted(&a, 2 * i + 1), array_size(&a));
+  }
+
+  array_destroy(&a);
+}
+
+/*
+ * array_lower_bound / array_upper_bound
+ */
+
+TEST(ArrayBoundTest, Duplicates) {
+  static const int origin[] = { 1, 2, 2, 2, 5, 6, 6, 9 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_EQ(array_lower_bound(&a, 2), 1u);
+  EXPECT_EQ(array_upper_bound(&a, 2), 4u);
+  EXPECT_EQ(array_lower_bound(&a, 6), 5u);
+  EXPECT_EQ(array_upper_bound(&a, 6), 7u);
+  EXPECT_EQ(array_lower_bound(&a, 3), 4u);
+  EXPECT_EQ(array_upper_bound(&a, 3), 4u);
+
+  array_destroy(&a);
+}
+
+TEST(ArrayBoundTest, OutOfRange) {
+  static const int origin[] = { 1, 2, 2, 2, 5, 6, 6, 9 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_EQ(array_lower_bound(&a, -1), 0u);
+  EXPECT_EQ(array_upper_bound(&a, -1), 0u);
+  EXPECT_EQ(array_lower_bound(&a, 10), std::size(origin));
+  EXPECT_EQ(array_upper_bound(&a, 9), std::size(origin));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayBoundTest, Empty) {
+  struct array a;
+  array_create(&a);
+
+  EXPECT_EQ(array_lower_bound(&a, 1), 0u);
+  EXPECT_EQ(array_upper_bound(&a, 1), 0u);
+
+  array_destroy(&a);
+}
+
+/*
+ * array_is_sorted
+ */
+
+TEST(ArrayIsSortedTest, Empty) {
+  struct array a;
+  array_create(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayIsSortedTest, Sorted) {
+  static const int origin[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayIsSortedTest, NotSorted) {
+  static const int origin[] = { 0, 1, 2, 3, 4, 5, 10, 9, 8, 7, 6 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_FALSE(array_is_sorted(&a));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayIsSortedTest, NotSortedAtTheEnd) {
+  static const int origin[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 0 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_FALSE(array_is_sorted(&a));
+
+  array_destroy(&a);
+}
+
+/*
+ * array_cache_sorted
+ */
+
+TEST(ArrayCacheSortedTest, AnswersFromTheFlag) {
+  struct array a;
+  array_create(&a);
+  array_cache_sorted(&a, true);
+  for (int i = 0; i < 10; ++i) {
+    array_push_back(&a, i);
+  }
+
+  EXPECT_TRUE(array_is_sorted(&a));
+  a.data[0] = 100; // not through the array functions, the cache does not see it
+  EXPECT_TRUE(array_is_sorted(&a));
+  array_cache_sorted(&a, false);
+  EXPECT_FALSE(array_is_sorted(&a));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayCacheSortedTest, ChangesClearTheFlag) {
+  static const int tail[] = { 60, 61, 62 };
+  static const int unsorted_tail[] = { 70, 63 };
+
+  struct array a;
+  array_create(&a);
+  array_cache_sorted(&a, true);
+  for (int i = 0; i < 10; ++i) {
+    array_push_back(&a, i);
+  }
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  array_set(&a, 3, 100);
+  EXPECT_FALSE(array_is_sorted(&a));
+  array_set(&a, 3, 3);
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  array_push_back(&a, -1);
+  EXPECT_FALSE(array_is_sorted(&a));
+  array_quick_sort(&a);
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  array_insert(&a, 50, 0);
+  EXPECT_FALSE(array_is_sorted(&a));
+  array_stable_sort(&a);
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  array_append_range(&a, tail, std::size(tail));
+  EXPECT_TRUE(array_is_sorted(&a));
+  array_insert_range(&a, a.size, unsorted_tail, std::size(unsorted_tail));
+  EXPECT_FALSE(array_is_sorted(&a));
+  array_heap_sort(&a);
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  array_swap(&a, 0, 1);
+  EXPECT_FALSE(array_is_sorted(&a));
+
+  array_destroy(&a);
+}
+
+/*
+ * array_sorted_insert, array_sorted_insert_batch
+ */
+
+TEST(ArraySortedInsertTest, KeepsTheOrder) {
+  for (enum array_storage storage : { ARRAY_STORAGE_CONTIGUOUS, ARRAY_STORAGE_GAP_BUFFER, ARRAY_STORAGE_TOMBSTONES }) {
+    SCOPED_TRACE("storage " + std::to_string(storage));
+    struct array a;
+    array_create(&a);
+    array_set_storage(&a, storage);
+    array_cache_sorted(&a, true);
+    std::vector<int> reference;
+
+    unsigned seed = 3;
+    for (int i = 0; i < 2 * BIG_SIZE; ++i) {
+      seed = seed * 1103515245u + 12345u;
+      int value = static_cast<int>((seed >> 8) % 1000);
+      if (i % 5 == 4) {
+        array_remove(&a, value % a.size);
+        reference.erase(reference.begin() + value % reference.size());
+      } else {
+        array_sorted_insert(&a, value);
+        reference.insert(std::upper_bound(reference.begin(), reference.end(), value), value);
+      }
+    }
+
+    EXPECT_TRUE(array_is_sorted(&a));
+    EXPECT_TRUE(array_equals(&a, reference.data(), reference.size()));
+    array_destroy(&a);
+  }
+}
+
+TEST(ArraySortedInsertTest, BatchMatchesStandardSort) {
+  struct array a;
+  array_create(&a);
+  array_cache_sorted(&a, true);
+  std::vector<int> reference;
+
+  unsigned seed = 5;
+  for (std::size_t k : { 0, 1, 5, 100, 3, 1000, 64 }) {
+    SCOPED_TRACE("batch " + std::to_string(k));
+    std::vector<int> batch(k);
+    for (std::size_t i = 0; i < k; ++i) {
+      seed = seed * 1103515245u + 12345u;
+      batch[i] = static_cast<int>((seed >> 8) % 500);
+    }
+    array_sorted_insert_batch(&a, batch.data(), batch.size());
+    reference.insert(reference.end(), batch.begin(), batch.end());
+    std::sort(reference.begin(), reference.end());
+
+    EXPECT_TRUE(array_is_sorted(&a));
+    EXPECT_TRUE(array_equals(&a, reference.data(), reference.size()));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArraySortedInsertTest, BatchAroundTheExistingValues) {
+  static const int origin[] = { 10, 20, 30 };
+  static const int batch[] = { 40, 20, 5, 30, 10, 25 };
+  static const int expected[] = { 5, 10, 10, 20, 20, 25, 30, 30, 40 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+  array_set_storage(&a, ARRAY_STORAGE_GAP_BUFFER);
+  array_remove(&a, 1);
+  array_insert(&a, 20, 1);
+
+  array_sorted_insert_batch(&a, batch, std::size(batch));
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+
+  array_destroy(&a);
+}
+
+/*
+ * array_merge, array_set_union, array_set_intersection, array_set_difference
+ */
+
+static std::vector<int> sorted_values(std::size_t n, unsigned range, unsigned seed) {
+  std::vector<int> values(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    values[i] = static_cast<int>((seed >> 8) % range) - static_cast<int>(range / 2);
+  }
+  std::sort(values.begin(), values.end());
+  return values;
+}
+
+static std::vector<int> array_values(const struct array *self) {
+  return std::vector<int>(self->data, self->data + self->size);
+}
+
+// sizes chosen to go through the block, galloping and tail paths
+static const std::size_t set_sizes[] = { 0, 1, 3, 7, 8, 9, 31, 100, 1000, 5000 };
+
+TEST(ArraySetOperationsTest, Merge) {
+  static const int left[] = { 1, 3, 3, 5, 7 };
+  static const int right[] = { 0, 3, 4, 8 };
+  static const int expected[] = { 0, 1, 3, 3, 3, 4, 5, 7, 8 };
+
+  struct array a, b, out;
+  array_create_from(&a, left, std::size(left));
+  array_create_from(&b, right, std::size(right));
+  array_create(&out);
+
+  EXPECT_TRUE(array_merge(&a, &b, &out));
+  EXPECT_TRUE(array_equals(&out, expected, std::size(expected)));
+
+  array_destroy(&a);
+  array_destroy(&b);
+  array_destroy(&out);
+}
+
+TEST(ArraySetOperationsTest, Union) {
+  static const int left[] = { 1, 3, 3, 5, 7 };
+  static const int right[] = { 0, 3, 4, 8, 8 };
+  static const int expected[] = { 0, 1, 3, 4, 5, 7, 8 };
+
+  struct array a, b, out;
+  array_create_from(&a, left, std::size(left));
+  array_create_from(&b, right, std::size(right));
+  array_create(&out);
+
+  EXPECT_TRUE(array_set_union(&a, &b, &out));
+  EXPECT_TRUE(array_equals(&out, expected, std::size(expected)));
+
+  array_destroy(&a);
+  array_destroy(&b);
+  array_destroy(&out);
+}
+
+TEST(ArraySetOperationsTest, Intersection) {
+  static const int left[] = { 1, 3, 3, 5, 7, 8 };
+  static const int right[] = { 0, 3, 3, 4, 8 };
+  static const int expected[] = { 3, 8 };
+
+  struct array a, b, out;
+  array_create_from(&a, left, std::size(left));
+  array_create_from(&b, right, std::size(right));
+  array_create(&out);
+
+  EXPECT_TRUE(array_set_intersection(&a, &b, &out));
+  EXPECT_TRUE(array_equals(&out, expected, std::size(expected)));
+
+  array_destroy(&a);
+  array_destroy(&b);
+  array_destroy(&out);
+}
+
+TEST(ArraySetOperationsTest, Difference) {
+  static const int left[] = { 1, 3, 3, 5, 5, 7, 8 };
+  static const int right[] = { 0, 3, 4, 8 };
+  static const int expected[] = { 1, 5, 7 };
+
+  struct array a, b, out;
+  array_create_from(&a, left, std::size(left));
+  array_create_from(&b, right, std::size(right));
+  array_create(&out);
+
+  EXPECT_TRUE(array_set_difference(&a, &b, &out));
+  EXPECT_TRUE(array_equals(&out, expected, std::size(expected)));
+
+  array_destroy(&a);
+  array_destroy(&b);
+  array_destroy(&out);
+}
+
+TEST(ArraySetOperationsTest, ReplacesOutput) {
+  static const int left[] = { 1, 2 };
+  static const int right[] = { 2, 3 };
+  static const int expected[] = { 2 };
+
+  struct array a, b, out;
+  array_create_from(&a, left, std::size(left));
+  array_create_from(&b, right, std::size(right));
+  array_create(&out);
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&out, i);
+  }
+
+  EXPECT_TRUE(array_set_intersection(&a, &b, &out));
+  EXPECT_TRUE(array_equals(&out, expected, std::size(expected)));
+
+  array_destroy(&a);
+  array_destroy(&b);
+  array_destroy(&out);
+}
+
+TEST(ArraySetOperationsTest, OutputAliasingAnInput) {
+  static const int origin[] = { 1, 2, 3 };
+
+  struct array a, b;
+  array_create_from(&a, origin, std::size(origin));
+  array_create_from(&b, origin, std::size(origin));
+
+  EXPECT_FALSE(array_merge(&a, &b, &a));
+  EXPECT_FALSE(array_set_union(&a, &b, &b));
+  EXPECT_FALSE(array_set_intersection(&a, &b, &a));
+  EXPECT_FALSE(array_set_difference(&a, &b, &b));
+  EXPECT_TRUE(array_equals(&a, origin, std::size(origin)));
+  EXPECT_TRUE(array_equals(&b, origin, std::size(origin)));
+
+  array_destroy(&a);
+  array_destroy(&b);
+}
+
+TEST(ArraySetOperationsTest, MatchesStandardAlgorithms) {
+  for (std::size_t na : set_sizes) {
+    for (std::size_t nb : set_sizes) {
+      for (unsigned range : { 4u, 64u, 100000u }) {
+        SCOPED_TRACE("sizes " + std::to_string(na) + " and " + std::to_string(nb) + ", range " + std::to_string(range));
+        std::vector<int> left = sorted_values(na, range, static_cast<unsigned>(na * 31 + range));
+        std::vector<int> right = sorted_values(nb, range, static_cast<unsigned>(nb * 17 + range + 1));
+
+        struct array a, b, out;
+        array_create_from(&a, left.data(), left.size());
+        array_create_from(&b, right.data(), right.size());
+        array_create(&out);
+
+        std::vector<int> expected;
+        std::merge(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(expected));
+        EXPECT_TRUE(array_merge(&a, &b, &out));
+        EXPECT_EQ(array_values(&out), expected);
+
+        expected.clear();
+        std::set_union(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(expected));
+        expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+        EXPECT_TRUE(array_set_union(&a, &b, &out));
+        EXPECT_EQ(array_values(&out), expected);
+
+        expected.clear();
+        std::set_intersection(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(expected));
+        expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+        EXPECT_TRUE(array_set_intersection(&a, &b, &out));
+        EXPECT_EQ(array_values(&out), expected);
+
+        // the standard difference counts duplicates, remove them from both inputs first
+        expected.clear();
+        left.erase(std::unique(left.begin(), left.end()), left.end());
+        right.erase(std::unique(right.begin(), right.end()), right.end());
+        std::set_difference(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(expected));
+        EXPECT_TRUE(array_set_difference(&a, &b, &out));
+        EXPECT_EQ(array_values(&out), expected);
+
+        array_destroy(&a);
+        array_destroy(&b);
+        array_destroy(&out);
+      }
+    }
+  }
+}
+
+/*
+ * array_partition
+ */
+
+TEST(ArrayPartitionTest, WholeSorted) {
+  static const int origin[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  ptrdiff_t p = array_partition(&a, 0, std::size(origin) - 1);
+  int pivot = array_get(&a, p);
+
+  for (ptrdiff_t i = 0; i < p; ++i) {
+    EXPECT_LT(array_get(&a, i), pivot);
+  }
+
+  for (ptrdiff_t i = p + 1; i < static_cast<ptrdiff_t>(std::size(origin)); ++i) {
+    EXPECT_GT(array_get(&a, i), pivot);
+  }
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayPartitionTest, WholeNotSorted) {
+  static const int origin[] = { 5, 4, 1, 6, 10, 3, 0, 9, 8, 2, 7 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  ptrdiff_t p = array_partition(&a, 0, std::size(origin) - 1);
+  int pivot = array_get(&a, p);
+
+  for (ptrdiff_t i = 0; i < p; ++i) {
+    EXPECT_LT(array_get(&a, i), pivot);
+  }
+
+  for (ptrdiff_t i = p + 1; i < static_cast<ptrdiff_t>(std::size(origin)); ++i) {
+    EXPECT_GT(array_get(&a, i), pivot);
+  }
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayPartitionTest, PartNotSorted) {
+  static const int origin[] = { 5, 4, 1, 6, 10, 3, 0, 9, 8, 2, 7 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  ptrdiff_t p = array_partition(&a, 3, 8);
+  int pivot = array_get(&a, p);
+
+  for (ptrdiff_t i = 3; i < p; ++i) {
+    EXPECT_LT(array_get(&a, i), pivot);
+  }
+
+  for (ptrdiff_t i = p + 1; i < 8; ++i) {
+    EXPECT_GT(array_get(&a, i), pivot);
+  }
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayPartitionTest, Single) {
+  static const int origin[] = { 5, 4, 1, 6, 10, 3, 0, 9, 8, 2, 7 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  ptrdiff_t p = array_partition(&a, 5, 5);
+
+  EXPECT_EQ(p, 5);
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+/*
+ * array_quick_sort
+ */
+
+TEST(ArrayQuickSortTest, NotSorted) {
+  static const int origin[] = { 8, 4, 1, 6, 10, 3, 0, 9, 5, 2, 7 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_FALSE(array_is_sorted(&a));
+
+  array_quick_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayQuickSortTest, SortedBackward) {
+  static const int origin[] = { 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_FALSE(array_is_sorted(&a));
+
+  array_quick_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayQuickSortTest, Sorted) {
+  static const int origin[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  array_quick_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayQuickSortTest, SortedStressed) {
+  struct array a;
+  array_create(&a);
+
+  for (int i = 0; i < 1000 * BIG_SIZE; ++i) {
+    array_push_back(&a, i);
+  }
+
+  array_quick_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+  EXPECT_EQ(array_size(&a), static_cast<std::size_t>(1000 * BIG_SIZE));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayQuickSortTest, SortedBackwardStressed) {
+  struct array a;
+  array_create(&a);
+
+  for (int i = 0; i < 1000 * BIG_SIZE; ++i) {
+    array_push_back(&a, 1000 * BIG_SIZE - i);
+  }
+
+  array_quick_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+  for (int i = 0; i < 1000 * BIG_SIZE; ++i) {
+    EXPECT_EQ(array_get(&a, i), i + 1);
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayQuickSortTest, AllEqual) {
+  struct array a;
+  array_create(&a);
+
+  for (int i = 0; i < 100 * BIG_SIZE; ++i) {
+    array_push_back(&a, 42);
+  }
+
+  array_quick_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+  EXPECT_EQ(array_search(&a, 42), 0u);
+
+  array_destroy(&a);
+}
+
+TEST(ArrayQuickSortTest, Random) {
+  struct array a;
+  array_create(&a);
+
+  std::srand(42);
+  long long sum = 0;
+  for (int i = 0; i < 100 * BIG_SIZE; ++i) {
+    int value = std::rand() % BIG_SIZE - BIG_SIZE / 2;
+    sum += value;
+    array_push_back(&a, value);
+  }
+
+  array_quick_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+  for (std::size_t i = 0; i < array_size(&a); ++i) {
+    sum -= array_get(&a, i);
+  }
+  EXPECT_EQ(sum, 0);
+
+  array_destroy(&a);
+}
+
+/*
+ * array_heap_sort
+ */
+
+TEST(ArrayHeapSortTest, NotSorted) {
+  static const int origin[] = { 8, 4, 1, 6, 10, 3, 0, 9, 5, 2, 7 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_FALSE(array_is_sorted(&a));
+
+  array_heap_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayHeapSortTest, SortedBackward) {
+  static const int origin[] = { 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_FALSE(array_is_sorted(&a));
+
+  array_heap_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayHeapSortTest, Sorted) {
+  static const int origin[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  array_heap_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayHeapSortTest, Random) {
+  struct array a;
+  array_create(&a);
+
+  std::srand(42);
+  long long sum = 0;
+  for (int i = 0; i < 100 * BIG_SIZE; ++i) {
+    int value = std::rand() % BIG_SIZE;
+    sum += value;
+    array_push_back(&a, value);
+  }
+
+  array_heap_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+  for (std::size_t i = 0; i < array_size(&a); ++i) {
+    sum -= array_get(&a, i);
+  }
+  EXPECT_EQ(sum, 0);
+
+  array_destroy(&a);
+}
+
+/*
+ * array_pdq_sort
+ */
+
+TEST(ArrayPdqSortTest, NotSorted) {
+  static const int origin[] = { 8, 4, 1, 6, 10, 3, 0, 9, 5, 2, 7 };
+  static const int expected[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_pdq_sort(&a);
+
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayPdqSortTest, MatchesStandardSort) {
+  // random, sorted, reversed, few unique values, organ pipe, sawtooth, sorted with a random tail
+  // and interleaved halves (a bad case for the median of three)
+  for (int shape = 0; shape < 8; ++shape) {
+    for (std::size_t n : { 0, 1, 2, 23, 24, 25, 127, 128, 129, 1000, 100 * BIG_SIZE }) {
+      SCOPED_TRACE("shape " + std::to_string(shape) + ", size " + std::to_string(n));
+      std::vector<int> values(n);
+      unsigned seed = 42;
+      for (std::size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        switch (shape) {
+          case 0: values[i] = static_cast<int>(seed >> 1) - INT_MAX / 2; break;
+          case 1: values[i] = static_cast<int>(i); break;
+          case 2: values[i] = static_cast<int>(n - i); break;
+          case 3: values[i] = static_cast<int>((seed >> 8) % 4); break;
+          case 4: values[i] = static_cast<int>(std::min(i, n - i)); break;
+          case 5: values[i] = static_cast<int>(i % 97); break;
+          case 6: values[i] = (i < n - n / 10) ? static_cast<int>(i) : static_cast<int>(seed >> 8); break;
+          case 7: values[i] = static_cast<int>((i % 2 == 0) ? i / 2 : n / 2 + i / 2); break;
+        }
+      }
+
+      struct array a;
+      array_create_from(&a, values.data(), n);
+      array_pdq_sort(&a);
+      std::sort(values.begin(), values.end());
+      EXPECT_TRUE(array_equals(&a, values.data(), n));
+      array_destroy(&a);
+    }
+  }
+}
+
+TEST(ArrayPdqSortTest, GapBuffer) {
+  struct array a;
+  array_create(&a);
+  array_set_storage(&a, ARRAY_STORAGE_GAP_BUFFER);
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_insert(&a, i, static_cast<std::size_t>(i / 2));
+  }
+
+  array_pdq_sort(&a);
+
+  EXPECT_EQ(a.gap_size, 0u);
+  EXPECT_TRUE(array_is_sorted(&a));
+  EXPECT_EQ(array_get(&a, BIG_SIZE - 1), BIG_SIZE - 1);
+
+  array_destroy(&a);
+}
+
+/*
+ * array_stable_sort
+ */
+
+TEST(ArrayStableSortTest, NotSorted) {
+  static const int origin[] = { 8, 4, 1, 6, 10, 3, 0, 9, 5, 2, 7 };
+  static const int expected[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_stable_sort(&a);
+
+  EXPECT_TRUE(array_equals(&a, expected, std::size(expected)));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayStableSortTest, SortedUsesNoScratch) {
+  struct array a;
+  array_create(&a);
+  for (int i = 0; i < 100 * BIG_SIZE; ++i) {
+    array_push_back(&a, i / 3);
+  }
+
+  array_stable_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+  EXPECT_EQ(a.scratch_capacity, 0u);
+
+  array_destroy(&a);
+}
+
+TEST(ArrayStableSortTest, Reverse) {
+  struct array a;
+  array_create(&a);
+  for (int i = 0; i < 100 * BIG_SIZE; ++i) {
+    array_push_back(&a, 100 * BIG_SIZE - i);
+  }
+
+  array_stable_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+  EXPECT_EQ(array_get(&a, 0), 1);
+  EXPECT_EQ(array_get(&a, 100 * BIG_SIZE - 1), 100 * BIG_SIZE);
+
+  array_destroy(&a);
+}
+
+/*
+ * Fill the array with the storage so that its elements are not contiguous, then sort it
+ */
+static void check_stable_sort_storage(enum array_storage storage) {
+  struct array a;
+  array_create(&a);
+  array_set_storage(&a, storage);
+  std::vector<int> reference;
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, BIG_SIZE - i);
+    reference.push_back(BIG_SIZE - i);
+  }
+  for (int i = 0; i < BIG_SIZE / 10; ++i) {
+    array_insert(&a, i % 7, BIG_SIZE / 2);
+    reference.insert(reference.begin() + BIG_SIZE / 2, i % 7);
+  }
+  for (int i = 0; i < BIG_SIZE / 10; ++i) {
+    array_remove(&a, 3 * i);
+    reference.erase(reference.begin() + 3 * i);
+  }
+  ASSERT_NE(a.gap_size + a.dead, 0u);
+
+  array_stable_sort(&a);
+  std::sort(reference.begin(), reference.end());
+
+  EXPECT_TRUE(array_equals(&a, reference.data(), reference.size()));
+  EXPECT_TRUE(std::equal(a.data, a.data + reference.size(), reference.begin()));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayStableSortTest, GapBuffer) {
+  check_stable_sort_storage(ARRAY_STORAGE_GAP_BUFFER);
+}
+
+TEST(ArrayStableSortTest, Tombstones) {
+  check_stable_sort_storage(ARRAY_STORAGE_TOMBSTONES);
+}
+
+TEST(ArrayStableSortTest, MatchesStandardSort) {
+  // random, sorted runs with appended data, organ pipe and few unique values
+  for (int shape = 0; shape < 4; ++shape) {
+    for (std::size_t n : { 0, 1, 2, 63, 64, 65, 1000, 100 * BIG_SIZE }) {
+      SCOPED_TRACE("shape " + std::to_string(shape) + ", size " + std::to_string(n));
+      std::vector<int> values(n);
+      unsigned seed = 42;
+      for (std::size_t i = 0; i < n; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        switch (shape) {
+          case 0: values[i] = static_cast<int>(seed >> 1); break;
+          case 1: values[i] = (i < n - n / 10) ? static_cast<int>(i % 5000) : static_cast<int>(seed >> 8); break;
+          case 2: values[i] = static_cast<int>(std::min(i, n - i)); break;
+          case 3: values[i] = static_cast<int>((seed >> 8) % 4); break;
+        }
+      }
+
+      struct array a;
+      array_create_from(&a, values.data(), n);
+      array_stable_sort(&a);
+      std::stable_sort(values.begin(), values.end());
+      EXPECT_TRUE(array_equals(&a, values.data(), n));
+      array_destroy(&a);
+    }
+  }
+}
+
+/*
+ * array_nth_element, array_partial_sort
+ */
+
+static std::vector<int> selection_input(std::size_t n, int shape) {
+  std::vector<int> values(n);
+  unsigned seed = 7;
+  for (std::size_t i = 0; i < n; ++i) {
+    seed = seed * 1103515245u + 12345u;
+    switch (shape) {
+      case 0: values[i] = static_cast<int>(seed >> 1) - INT_MAX / 2; break;
+      case 1: values[i] = static_cast<int>(i); break;
+      case 2: values[i] = static_cast<int>((seed >> 8) % 3); break;
+      case 3: values[i] = static_cast<int>(std::min(i, n - i)); break;
+    }
+  }
+  return values;
+}
+
+TEST(ArrayNthElementTest, Median) {
+  static const int origin[] = { 8, 4, 1, 6, 10, 3, 0, 9, 5, 2, 7 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_nth_element(&a, 5);
+
+  EXPECT_EQ(array_get(&a, 5), 5);
+  for (std::size_t i = 0; i < 5; ++i) {
+    EXPECT_LT(array_get(&a, i), 5);
+  }
+  for (std::size_t i = 6; i < std::size(origin); ++i) {
+    EXPECT_GT(array_get(&a, i), 5);
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayNthElementTest, OutOfRange) {
+  static const int origin[] = { 3, 1, 2 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_nth_element(&a, 3);
+
+  EXPECT_TRUE(array_equals(&a, origin, std::size(origin)));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayNthElementTest, MatchesStandardSelection) {
+  for (int shape = 0; shape < 4; ++shape) {
+    for (std::size_t n : { 1, 17, 1000, 100 * BIG_SIZE }) {
+      std::vector<int> sorted = selection_input(n, shape);
+      std::sort(sorted.begin(), sorted.end());
+      for (std::size_t k : { std::size_t(0), n / 2, n * 99 / 100, n - 1 }) {
+        SCOPED_TRACE("shape " + std::to_string(shape) + ", size " + std::to_string(n) + ", k " + std::to_string(k));
+        std::vector<int> values = selection_input(n, shape);
+        struct array a;
+        array_create_from(&a, values.data(), n);
+
+        array_nth_element(&a, k);
+
+        EXPECT_EQ(array_get(&a, k), sorted[k]);
+        for (std::size_t i = 0; i < k; ++i) {
+          ASSERT_LE(array_get(&a, i), sorted[k]);
+        }
+        for (std::size_t i = k + 1; i < n; ++i) {
+          ASSERT_GE(array_get(&a, i), sorted[k]);
+        }
+        array_destroy(&a);
+      }
+    }
+  }
+}
+
+TEST(ArrayPartialSortTest, MatchesStandardSort) {
+  for (int shape = 0; shape < 4; ++shape) {
+    for (std::size_t n : { 0, 1, 17, 1000, 100 * BIG_SIZE }) {
+      std::vector<int> sorted = selection_input(n, shape);
+      std::sort(sorted.begin(), sorted.end());
+      for (std::size_t k : { std::size_t(0), std::size_t(1), std::size_t(100), n, n + 1 }) {
+        SCOPED_TRACE("shape " + std::to_string(shape) + ", size " + std::to_string(n) + ", k " + std::to_string(k));
+        std::vector<int> values = selection_input(n, shape);
+        struct array a;
+        array_create_from(&a, values.data(), n);
+
+        array_partial_sort(&a, k);
+
+        std::size_t m = std::min(k, n);
+        EXPECT_TRUE(std::equal(a.data, a.data + m, sorted.data()));
+        array_quick_sort(&a);
+        EXPECT_TRUE(array_equals(&a, sorted.data(), n));
+        array_destroy(&a);
+      }
+    }
+  }
+}
+
+/*
+ * array_radix_sort
+ */
+
+TEST(ArrayRadixSortTest, NotSorted) {
+  static const int origin[] = { 8, 4, 1, 6, 10, 3, 0, 9, 5, 2, 7 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_radix_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayRadixSortTest, Negative) {
+  struct array a;
+  array_create(&a);
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, (i % 2 == 0) ? -i : i);
+  }
+  array_push_back(&a, INT_MIN);
+  array_push_back(&a, INT_MAX);
+
+  array_radix_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+  EXPECT_EQ(array_get(&a, 0), INT_MIN);
+  EXPECT_EQ(array_get(&a, BIG_SIZE + 1), INT_MAX);
+
+  array_destroy(&a);
+}
+
+TEST(ArrayRadixSortTest, Random) {
+  struct array a;
+  array_create(&a);
+
+  std::srand(42);
+  long long sum = 0;
+  for (int i = 0; i < 100 * BIG_SIZE; ++i) {
+    int value = std::rand() - RAND_MAX / 2;
+    sum += value;
+    array_push_back(&a, value);
+  }
+
+  array_radix_sort(&a);
+  array_radix_sort(&a); // the scratch buffer is reused
+
+  EXPECT_TRUE(array_is_sorted(&a));
+  for (std::size_t i = 0; i < array_size(&a); ++i) {
+    sum -= array_get(&a, i);
+  }
+  EXPECT_EQ(sum, 0);
+
+  array_destroy(&a);
+}
+
+TEST(ArrayRadixSortTest, SmallValues) {
+  struct array a;
+  array_create(&a);
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, (i * 7) % 100);
+  }
+
+  array_radix_sort(&a);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  array_destroy(&a);
+}
+
+/*
+ * array_parallel_sort
+ */
+
+TEST(ArrayParallelSortTest, Small) {
+  static const int origin[] = { 8, 4, 1, 6, 10, 3, 0, 9, 5, 2, 7 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_parallel_sort(&a, 4);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  for (int val : origin) {
+    EXPECT_NE(array_search(&a, val), std::size(origin));
+  }
+
+  array_destroy(&a);
+}
+
+TEST(ArrayParallelSortTest, Random) {
+  struct array a;
+  array_create(&a);
+
+  std::srand(42);
+  long long sum = 0;
+  for (int i = 0; i < 1000 * BIG_SIZE; ++i) {
+    int value = std::rand() - RAND_MAX / 2;
+    sum += value;
+    array_push_back(&a, value);
+  }
+
+  array_parallel_sort(&a, 4);
+
+  EXPECT_EQ(array_size(&a), static_cast<std::size_t>(1000 * BIG_SIZE));
+  EXPECT_TRUE(array_is_sorted(&a));
+  for (std::size_t i = 0; i < array_size(&a); ++i) {
+    sum -= array_get(&a, i);
+  }
+  EXPECT_EQ(sum, 0);
+
+  array_destroy(&a);
+}
+
+TEST(ArrayParallelSortTest, FewUnique) {
+  struct array a;
+  array_create(&a);
+
+  for (int i = 0; i < 1000 * BIG_SIZE; ++i) {
+    array_push_back(&a, i % 3);
+  }
+
+  array_parallel_sort(&a, 0);
+
+  EXPECT_TRUE(array_is_sorted(&a));
+  EXPECT_EQ(array_lower_bound(&a, 1), static_cast<std::size_t>(1000 * BIG_SIZE / 3 + 1));
+
+  array_destroy(&a);
+}
+
+/*
+ * array_is_heap
+ */
+
+TEST(ArrayIsHeapTest, Empty) {
+  struct array a;
+  array_create(&a);
+
+  EXPECT_TRUE(array_is_heap(&a));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayIsHeapTest, SimpleHeap1) {
+  static const int origin[] = { 13, 6, 8, 5, 3 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_TRUE(array_is_heap(&a));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayIsHeapTest, SimpleHeap2) {
+  static const int origin[] = { 81, 45, 24, 21, 6, 17, 19, 14 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_TRUE(array_is_heap(&a));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayIsHeapTest, NotHeap1) {
+  static const int origin[] = { 6, 5, 4, 3, 1, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_FALSE(array_is_heap(&a));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayIsHeapTest, NotHeap2) {
+  static const int origin[] = { 6, 5, 4, 3, 1, 0, 8 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  EXPECT_FALSE(array_is_heap(&a));
+
+  array_destroy(&a);
+}
+
+/*
+ * array_heap_add
+ */
+
+TEST(ArrayHeapAddTest, Stressed) {
+  struct array a;
+
+  array_create(&a);
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_heap_add(&a, i);
+    EXPECT_EQ(i, array_heap_top(&a));
+    EXPECT_TRUE(array_is_heap(&a));
+  }
+
+  array_destroy(&a);
+}
+
+/*
+ * array_heap_remove_top
+ */
+
+TEST(ArrayHeapRemoveTopTest, Stressed) {
+  struct array a;
+
+  array_create(&a);
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_heap_add(&a, i);
+  }
+
+  EXPECT_TRUE(array_is_heap(&a));
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    EXPECT_EQ(BIG_SIZE - i - 1, array_heap_top(&a));
+    array_heap_remove_top(&a);
+  }
+
+  EXPECT_TRUE(array_empty(&a));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayHeapRemoveTopTest, Duplicates) {
+  struct array a;
+
+  array_create(&a);
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_heap_add(&a, (i * 7919) % 10);
+  }
+
+  int previous = array_heap_top(&a);
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    EXPECT_LE(array_heap_top(&a), previous);
+    previous = array_heap_top(&a);
+    array_heap_remove_top(&a);
+    EXPECT_TRUE(array_is_heap(&a));
+  }
+
+  EXPECT_TRUE(array_empty(&a));
+
+  array_destroy(&a);
+}
+
+/*
+ * array_top_k
+ */
+
+TEST(ArrayTopKTest, Largest) {
+  static const int origin[] = { 8, 4, 1, 6, 10, 3, 0, 9, 5, 2, 7 };
+  static const int expected[] = { 10, 9, 8, 7 };
+
+  struct array a, out;
+  array_create_from(&a, origin, std::size(origin));
+  array_create(&out);
+
+  EXPECT_TRUE(array_top_k(&a, 4, &out));
+  EXPECT_TRUE(array_equals(&out, expected, std::size(expected)));
+  EXPECT_TRUE(array_equals(&a, origin, std::size(origin)));
+
+  array_destroy(&a);
+  array_destroy(&out);
+}
+
+TEST(ArrayTopKTest, MoreThanSize) {
+  static const int origin[] = { 2, 3, 1 };
+  static const int expected[] = { 3, 2, 1 };
+
+  struct array a, out;
+  array_create_from(&a, origin, std::size(origin));
+  array_create(&out);
+
+  EXPECT_TRUE(array_top_k(&a, 10, &out));
+  EXPECT_TRUE(array_equals(&out, expected, std::size(expected)));
+  EXPECT_FALSE(array_top_k(&a, 1, &a));
+
+  array_destroy(&a);
+  array_destroy(&out);
+}
+
+TEST(ArrayTopKTest, Zero) {
+  static const int origin[] = { 2, 3, 1 };
+
+  struct array a, out;
+  array_create_from(&a, origin, std::size(origin));
+  array_create_adopt(&out, nullptr, 0, 0);
+
+  EXPECT_TRUE(array_top_k(&a, 0, &out));
+  EXPECT_TRUE(array_empty(&out));
+  EXPECT_EQ(out.data, nullptr);
+
+  array_destroy(&a);
+  array_destroy(&out);
+}
+
+TEST(ArrayTopKTest, MatchesStandardSort) {
+  for (int shape = 0; shape < 4; ++shape) {
+    std::vector<int> values = selection_input(100 * BIG_SIZE, shape);
+    std::vector<int> sorted = values;
+    std::sort(sorted.begin(), sorted.end(), std::greater<int>());
+    struct array a, out;
+    array_create_from(&a, values.data(), values.size());
+    array_create(&out);
+
+    for (std::size_t k : { 0, 1, 100, 1000 }) {
+      SCOPED_TRACE("shape " + std::to_string(shape) + ", k " + std::to_string(k));
+      EXPECT_TRUE(array_top_k(&a, k, &out));
+      EXPECT_TRUE(array_equals(&out, sorted.data(), k));
+    }
+
+    array_destroy(&a);
+    array_destroy(&out);
+  }
+}
+
+/*
+ * array_set_heap_arity
+ */
+
+static const unsigned heap_arities[] = { 4, 8 };
+
+TEST(ArrayHeapArityTest, IsHeap) {
+  static const int origin[] = { 20, 10, 11, 12, 13, 1, 2, 3, 4, 5 };
+
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+
+  array_set_heap_arity(&a, 4);
+  EXPECT_TRUE(array_is_heap(&a));
+
+  array_set(&a, 8, 42);
+  EXPECT_FALSE(array_is_heap(&a));
+
+  array_destroy(&a);
+}
+
+TEST(ArrayHeapArityTest, Stressed) {
+  for (unsigned arity : heap_arities) {
+    struct array a;
+    array_create(&a);
+    array_set_heap_arity(&a, arity);
+
+    for (int i = 0; i < BIG_SIZE; ++i) {
+      array_heap_add(&a, (i * 7919) % BIG_SIZE);
+      EXPECT_TRUE(array_is_heap(&a));
+    }
+
+    for (int i = 0; i < BIG_SIZE; ++i) {
+      EXPECT_EQ(BIG_SIZE - i - 1, array_heap_top(&a));
+      array_heap_remove_top(&a);
+      EXPECT_TRUE(array_is_heap(&a));
+    }
+
+    EXPECT_TRUE(array_empty(&a));
+
+    array_destroy(&a);
+  }
+}
+
+TEST(ArrayHeapArityTest, HeapSort) {
+  for (unsigned arity : heap_arities) {
+    static const int origin[] = { 8, 4, 1, 6, 10, 3, 0, 9, 5, 2, 7 };
+
+    struct array a;
+    array_create_from(&a, origin, std::size(origin));
+    array_set_heap_arity(&a, arity);
+
+    array_heap_sort(&a);
+
+    EXPECT_TRUE(array_is_sorted(&a));
+
+    for (int val : origin) {
+      EXPECT_NE(array_search(&a, val), std::size(origin));
+    }
+
+    array_destroy(&a);
+  }
+}
+
+/*
+ * array_create_with_allocator
+ */
+
+TEST(ArrayAllocatorTest, Arena) {
+  struct array_arena arena;
+  array_arena_create(&arena, 4096);
+
+  for (int round = 0; round < 10; ++round) {
+    struct array arrays[10];
+    for (struct array& a : arrays) {
+      array_create_with_allocator(&a, &arena.allocator);
+    }
+    for (int i = 0; i < BIG_SIZE; ++i) {
+      for (struct array& a : arrays) {
+        array_push_back(&a, i);
+      }
+    }
+    for (struct array& a : arrays) {
+      EXPECT_EQ(array_size(&a), static_cast<std::size_t>(BIG_SIZE));
+      for (int i = 0; i < BIG_SIZE; ++i) {
+        EXPECT_EQ(array_get(&a, i), i);
+      }
+    }
+    array_arena_reset(&arena); // no need to destroy the arrays
+  }
+
+  array_arena_destroy(&arena);
+}
+
+TEST(ArrayAllocatorTest, ArenaLastGrowsInPlace) {
+  struct array_arena arena;
+  array_arena_create(&arena, 0);
+
+  struct array a;
+  array_create_with_allocator(&a, &arena.allocator);
+  EXPECT_TRUE(array_reserve(&a, 2 * ARRAY_INLINE_CAPACITY));
+  int *data = a.data;
+
+  EXPECT_TRUE(array_reserve(&a, BIG_SIZE));
+  EXPECT_EQ(a.data, data);
+
+  array_destroy(&a);
+  array_arena_destroy(&arena);
+}
+
+TEST(ArrayAllocatorTest, Pool) {
+  struct array_pool pool;
+  array_pool_create(&pool);
+
+  for (int round = 0; round < 10; ++round) {
+    struct array arrays[10];
+    for (struct array& a : arrays) {
+      array_create_with_allocator(&a, &pool.allocator);
+    }
+    for (int i = 0; i < 100 * BIG_SIZE; ++i) {
+      array_push_back(&arrays[i % 10], i);
+    }
+    for (int k = 0; k < 10; ++k) {
+      EXPECT_EQ(array_size(&arrays[k]), static_cast<std::size_t>(10 * BIG_SIZE));
+      for (int i = 0; i < 10 * BIG_SIZE; ++i) {
+        EXPECT_EQ(array_get(&arrays[k], i), 10 * i + k);
+      }
+      array_shrink_to_fit(&arrays[k]);
+    }
+    for (struct array& a : arrays) {
+      array_destroy(&a);
+    }
+  }
+
+  array_pool_destroy(&pool);
+}
+
+TEST(ArrayAllocatorTest, PoolSort) {
+  struct array_pool pool;
+  array_pool_create(&pool);
+
+  struct array a;
+  array_create_with_allocator(&a, &pool.allocator);
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, BIG_SIZE - i);
+  }
+
+  array_radix_sort(&a); // the scratch buffer comes from the pool too
+
+  EXPECT_TRUE(array_is_sorted(&a));
+
+  array_destroy(&a);
+  array_pool_destroy(&pool);
+}
+
+/*
+ * array_concurrent
+ */
+
+TEST(ArrayConcurrentTest, PushBackAndGet) {
+  struct array_concurrent a;
+  array_concurrent_create(&a);
+
+  for (int i = 0; i < 100 * BIG_SIZE; ++i) {
+    EXPECT_TRUE(array_concurrent_push_back(&a, i));
+  }
+
+  EXPECT_EQ(array_concurrent_size(&a), static_cast<std::size_t>(100 * BIG_SIZE));
+  for (int i = 0; i < 100 * BIG_SIZE; ++i) {
+    ASSERT_EQ(array_concurrent_get(&a, i), i);
+  }
+
+  array_concurrent_destroy(&a);
+}
+
+TEST(ArrayConcurrentTest, AppendRangeAcrossSegments) {
+  std::vector<int> values(1000);
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    values[i] = static_cast<int>(i);
+  }
+
+  struct array_concurrent a;
+  array_concurrent_create(&a);
+  struct array out;
+  array_create(&out);
+
+  EXPECT_TRUE(array_concurrent_append_range(&a, values.data(), 10));
+  EXPECT_TRUE(array_concurrent_append_range(&a, values.data() + 10, values.size() - 10));
+  EXPECT_TRUE(array_concurrent_append_range(&a, nullptr, 0));
+  EXPECT_TRUE(array_concurrent_snapshot(&a, &out));
+  EXPECT_TRUE(array_equals(&out, values.data(), values.size()));
+
+  array_destroy(&out);
+  array_concurrent_destroy(&a);
+}
+
+TEST(ArrayConcurrentTest, ManyWriters) {
+  static const int writers = 8;
+  static const int per_writer = 20 * BIG_SIZE;
+
+  struct array_concurrent a;
+  array_concurrent_create(&a);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < writers; ++t) {
+    threads.emplace_back([&a, t] {
+      for (int i = 0; i < per_writer; ++i) {
+        array_concurrent_push_back(&a, t * per_writer + i);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  struct array out;
+  array_create(&out);
+  EXPECT_TRUE(array_concurrent_snapshot(&a, &out));
+  array_quick_sort(&out);
+  ASSERT_EQ(array_size(&out), static_cast<std::size_t>(writers * per_writer));
+  for (int i = 0; i < writers * per_writer; ++i) {
+    ASSERT_EQ(array_get(&out, i), i);
+  }
+
+  array_destroy(&out);
+  array_concurrent_destroy(&a);
+}
+
+TEST(ArrayConcurrentTest, SnapshotWhileWriting) {
+  static const int writers = 4;
+  static const int per_writer = 20 * BIG_SIZE;
+
+  struct array_concurrent a;
+  array_concurrent_create(&a);
+
+  // each writer appends increasing values, so every snapshot must see them in order
+  std::vector<std::thread> threads;
+  for (int t = 0; t < writers; ++t) {
+    threads.emplace_back([&a, t] {
+      for (int i = 0; i < per_writer; ++i) {
+        array_concurrent_push_back(&a, i * writers + t);
+      }
+    });
+  }
+
+  struct array out;
+  array_create(&out);
+  std::size_t previous = 0;
+  while (previous < static_cast<std::size_t>(writers * per_writer)) {
+    ASSERT_TRUE(array_concurrent_snapshot(&a, &out));
+    ASSERT_GE(array_size(&out), previous);
+    previous = array_size(&out);
+    std::vector<int> last(writers, -1);
+    for (std::size_t i = 0; i < previous; ++i) {
+      int value = array_get(&out, i);
+      ASSERT_GT(value, last[value % writers]);
+      last[value % writers] = value;
+    }
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  array_destroy(&out);
+  array_concurrent_destroy(&a);
+}
+
+#ifdef DARRAY_STATS
+
+/*
+ * array_stats_dump, array_stats_global, array_stats_set_hook
+ */
+
+TEST(ArrayStatsTest, Growth) {
+  struct array a;
+  array_create(&a);
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_push_back(&a, i);
+  }
+
+  EXPECT_GT(a.stats.reallocs, 0u);
+  EXPECT_GT(a.stats.bytes_copied, 0u);
+  EXPECT_EQ(a.stats.peak_size, static_cast<uint64_t>(BIG_SIZE));
+  EXPECT_EQ(a.stats.peak_capacity, a.capacity);
+  array_erase_range(&a, 0, BIG_SIZE / 2);
+  array_shrink_to_fit(&a);
+  EXPECT_EQ(a.stats.peak_size, static_cast<uint64_t>(BIG_SIZE));
+  EXPECT_GT(a.stats.peak_capacity, a.capacity);
+
+  array_stats_reset(&a);
+  EXPECT_EQ(a.stats.reallocs, 0u);
+  array_destroy(&a);
+}
+
+TEST(ArrayStatsTest, SortAndSearch) {
+  std::vector<int> values(BIG_SIZE);
+  for (std::size_t i = 0; i < values.size(); ++i) {
+    values[i] = static_cast<int>((i * 7919) % BIG_SIZE);
+  }
+  struct array a;
+  array_create_from(&a, values.data(), values.size());
+
+  array_quick_sort(&a);
+  EXPECT_EQ(a.stats.sorts, 1u); // the nested calls are not counted again
+  EXPECT_GT(a.stats.comparisons, static_cast<uint64_t>(BIG_SIZE));
+  EXPECT_GT(a.stats.swaps, 0u);
+
+  array_search_sorted(&a, 10);
+  array_search(&a, 10);
+  EXPECT_EQ(a.stats.searches, 2u);
+  EXPECT_EQ(a.stats.sorts, 1u);
+
+  array_destroy(&a);
+}
+
+TEST(ArrayStatsTest, Global) {
+  struct array a, b;
+  array_create(&a);
+  array_create(&b);
+  array_stats_reset_global();
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_heap_add(&a, i);
+    array_heap_add(&b, -i);
+  }
+  array_heap_remove_top(&a);
+
+  struct array_stats stats;
+  array_stats_global(&stats);
+  EXPECT_EQ(stats.comparisons, a.stats.comparisons + b.stats.comparisons);
+  EXPECT_EQ(stats.reallocs, a.stats.reallocs + b.stats.reallocs);
+  EXPECT_GT(a.stats.comparisons, b.stats.comparisons);
+  EXPECT_EQ(stats.peak_size, static_cast<uint64_t>(BIG_SIZE));
+
+  array_destroy(&a);
+  array_destroy(&b);
+}
+
+TEST(ArrayStatsTest, Dump) {
+  struct array_stats stats = {};
+  stats.reallocs = 3;
+  stats.peak_capacity = 40;
+
+  char text[512];
+  int n = array_stats_dump(text, sizeof(text), &stats, ARRAY_STATS_TEXT);
+  EXPECT_EQ(n, static_cast<int>(std::strlen(text)));
+  EXPECT_EQ(std::string(text).rfind("reallocs", 0), 0u);
+  EXPECT_NE(std::string(text).find("peak_capacity  40\n"), std::string::npos);
+
+  char json[512];
+  n = array_stats_dump(json, sizeof(json), &stats, ARRAY_STATS_JSON);
+  EXPECT_EQ(std::string(json).rfind("{\"reallocs\": 3, \"bytes_copied\": 0, ", 0), 0u);
+  EXPECT_EQ(std::string(json).substr(n - 2), "}\n");
+
+  char cut[8];
+  EXPECT_EQ(array_stats_dump(cut, sizeof(cut), &stats, ARRAY_STATS_JSON), n);
+  EXPECT_EQ(std::string(cut), std::string(json, sizeof(cut) - 1));
+  EXPECT_EQ(array_stats_dump(nullptr, 0, &stats, ARRAY_STATS_JSON), n);
+}
+
+TEST(ArrayStatsTest, PdqSortComparisons) {
+  // sorted and equal values are close to linear, the patterns that defeat the median of three stay in n log n
+  const std::size_t n = 100 * BIG_SIZE;
+  const uint64_t n_log_n = n * 17;
+  for (int shape = 0; shape < 5; ++shape) {
+    SCOPED_TRACE("shape " + std::to_string(shape));
+    std::vector<int> values(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      switch (shape) {
+        case 0: values[i] = static_cast<int>(i); break;
+        case 1: values[i] = 7; break;
+        case 2: values[i] = static_cast<int>(std::min(i, n - i)); break;
+        case 3: values[i] = static_cast<int>((i % 2 == 0) ? i / 2 : n / 2 + i / 2); break;
+        case 4: values[i] = static_cast<int>(i % 64); break;
+      }
+    }
+    struct array a;
+    array_create_from(&a, values.data(), n);
+    array_pdq_sort(&a);
+    EXPECT_TRUE(array_is_sorted(&a));
+    EXPECT_LT(a.stats.comparisons, (shape < 2) ? 3 * n : 3 * n_log_n);
+    array_destroy(&a);
+  }
+}
+
+static void record_call(void *context, const char *function, size_t size, uint64_t) {
+  static_cast<std::vector<std::string> *>(context)->push_back(std::string(function) + " " + std::to_string(size));
+}
+
+TEST(ArrayStatsTest, Hook) {
+  static const int origin[] = { 3, 1, 2 };
+
+  std::vector<std::string> calls;
+  struct array a;
+  array_create_from(&a, origin, std::size(origin));
+  array_stats_set_hook(record_call, &calls);
+  array_partial_sort(&a, 2);
+  array_lower_bound(&a, 2);
+  array_swap(&a, 0, 1);
+  array_stats_set_hook(nullptr, nullptr);
+  array_quick_sort(&a);
+
+  EXPECT_EQ(calls, std::vector<std::string>({ "array_partial_sort 3", "array_lower_bound 3" }));
+  array_destroy(&a);
+}
+
+TEST(ArrayStatsTest, ParallelSort) {
+  const std::size_t n = 1000 * BIG_SIZE;
+  std::vector<std::string> calls;
+  struct array a;
+  array_create(&a);
+  std::srand(42);
+  for (std::size_t i = 0; i < n; ++i) {
+    array_push_back(&a, std::rand());
+  }
+
+  array_stats_set_hook(record_call, &calls);
+  array_parallel_sort(&a, 4);
+  array_stats_set_hook(nullptr, nullptr);
+
+  // the buckets sorted by the workers count in the one parallel sort
+  EXPECT_TRUE(array_is_sorted(&a));
+  EXPECT_EQ(calls, std::vector<std::string>({ "array_parallel_sort " + std::to_string(n) }));
+  EXPECT_EQ(a.stats.sorts, 1u);
+  EXPECT_GT(a.stats.comparisons, 10 * n);
+  array_destroy(&a);
+}
+
+#endif
+
+/*
+ * array_simd_select
+ */
+
+static const enum array_simd simd_levels[] = { ARRAY_SIMD_SCALAR, ARRAY_SIMD_SSE2, ARRAY_SIMD_AVX2, ARRAY_SIMD_AVX512 };
+
+TEST(ArraySimdSelectTest, Search) {
+  for (enum array_simd level : simd_levels) {
+    array_simd_select(level);
+
+    for (int n = 0; n < 100; ++n) {
+      struct array a;
+      array_create(&a);
+      for (int i = 0; i < n; ++i) {
+        array_push_back(&a, i);
+      }
+      for (int i = 0; i < n; ++i) {
+        EXPECT_EQ(array_search(&a, i), static_cast<std::size_t>(i));
+      }
+      EXPECT_EQ(array_search(&a, -1), static_cast<std::size_t>(n));
+      array_destroy(&a);
+    }
+  }
+
+  array_simd_select(ARRAY_SIMD_AVX512);
+}
+
+TEST(ArraySimdSelectTest, Equals) {
+  for (enum array_simd level : simd_levels) {
+    array_simd_select(level);
+
+    for (int n = 1; n < 100; ++n) {
+      std::vector<int> reference(n);
+      for (int i = 0; i < n; ++i) {
+        reference[i] = i;
+      }
+      struct array a;
+      array_create_from(&a, reference.data(), n);
+      EXPECT_TRUE(array_equals(&a, reference.data(), n));
+      for (int i = 0; i < n; ++i) {
+        reference[i] = -1;
+        EXPECT_FALSE(array_equals(&a, reference.data(), n));
+        reference[i] = i;
+      }
+      array_destroy(&a);
+    }
+  }
+
+  array_simd_select(ARRAY_SIMD_AVX512);
+}
+
+TEST(ArraySimdSelectTest, SetIntersection) {
+  for (enum array_simd level : simd_levels) {
+    array_simd_select(level);
+
+    for (std::size_t n = 0; n < 100; ++n) {
+      for (unsigned range : { 8u, 256u }) {
+        std::vector<int> left = sorted_values(n, range, static_cast<unsigned>(n));
+        std::vector<int> right = sorted_values(n + n / 3, range, static_cast<unsigned>(n + 7));
+        std::vector<int> expected;
+        std::set_intersection(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(expected));
+        expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+
+        struct array a, b, out;
+        array_create_from(&a, left.data(), left.size());
+        array_create_from(&b, right.data(), right.size());
+        array_create(&out);
+        EXPECT_TRUE(array_set_intersection(&a, &b, &out));
+        EXPECT_EQ(array_values(&out), expected);
+        array_destroy(&a);
+        array_destroy(&b);
+        array_destroy(&out);
+      }
+    }
+  }
+
+  array_simd_select(ARRAY_SIMD_AVX512);
+}
+
+TEST(ArraySimdSelectTest, IsSorted) {
+  for (enum array_simd level : simd_levels) {
+    array_simd_select(level);
+
+    for (int n = 2; n < 100; ++n) {
+      struct array a;
+      array_create(&a);
+      for (int i = 0; i < n; ++i) {
+        array_push_back(&a, i);
+      }
+      EXPECT_TRUE(array_is_sorted(&a));
+      for (int i = 1; i < n; ++i) {
+        array_set(&a, i, i - 2);
+        EXPECT_FALSE(array_is_sorted(&a));
+        array_set(&a, i, i);
+      }
+      array_destroy(&a);
+    }
+  }
+
+  array_simd_select(ARRAY_SIMD_AVX512);
+}
+
+TEST(ArraySimdSelectTest, IsHeap) {
+  for (enum array_simd level : simd_levels) {
+    array_simd_select(level);
+
+    for (int n = 2; n < 100; ++n) {
+      struct array a;
+      array_create(&a);
+      for (int i = 0; i < n; ++i) {
+        array_push_back(&a, 2 * (n - i));
+      }
+      EXPECT_TRUE(array_is_heap(&a));
+      for (int i = 1; i < n; ++i) {
+        array_set(&a, i, 2 * n + 1);
+        EXPECT_FALSE(array_is_heap(&a));
+        array_set(&a, i, 2 * (n - i));
+      }
+      array_destroy(&a);
+    }
+  }
+
+  array_simd_select(ARRAY_SIMD_AVX512);
+}
+
+/*
+ * ARRAY_DEFINE
+ */
+
+ARRAY_DEFINE(double, array_double, ARRAY_LESS)
+ARRAY_DEFINE(std::int64_t, array_int64, ARRAY_LESS)
+
+struct record {
+  int key;
+  float weight;
+};
+
+#define RECORD_LESS(a, b) ((a).key < (b).key)
+
+ARRAY_DEFINE(struct record, array_record, RECORD_LESS)
+
+TEST(ArrayDefineTest, Double) {
+  static const double origin[] = { 8.5, 4.25, -1.0, 6.0, 10.5, 3.0, 0.0, 9.75, 5.5, 2.0, 7.0 };
+
+  struct array_double a;
+  array_double_create_from(&a, origin, std::size(origin));
+
+  EXPECT_EQ(array_double_size(&a), std::size(origin));
+  EXPECT_TRUE(array_double_equals(&a, origin, std::size(origin)));
+  EXPECT_FALSE(array_double_is_sorted(&a));
+
+  array_double_quick_sort(&a);
+
+  EXPECT_TRUE(array_double_is_sorted(&a));
+  EXPECT_EQ(array_double_get(&a, 0), -1.0);
+  EXPECT_EQ(array_double_search_sorted(&a, 9.75), a.size - 2);
+  EXPECT_EQ(array_double_search_sorted(&a, 9.0), a.size);
+
+  array_double_heap_sort(&a);
+
+  EXPECT_TRUE(array_double_is_sorted(&a));
+
+  array_double_destroy(&a);
+}
+
+TEST(ArrayDefineTest, Int64Stressed) {
+  struct array_int64 a;
+  array_int64_create(&a);
+
+  for (std::int64_t i = 0; i < BIG_SIZE; ++i) {
+    array_int64_insert(&a, i << 40, a.size / 2);
+  }
+
+  EXPECT_EQ(array_int64_size(&a), static_cast<std::size_t>(BIG_SIZE));
+  EXPECT_FALSE(array_int64_is_sorted(&a));
+
+  array_int64_quick_sort(&a);
+
+  for (std::int64_t i = 0; i < BIG_SIZE; ++i) {
+    EXPECT_EQ(array_int64_get(&a, i), i << 40);
+    EXPECT_EQ(array_int64_search_sorted(&a, i << 40), static_cast<std::size_t>(i));
+  }
+
+  array_int64_erase_range(&a, 10, BIG_SIZE - 10);
+  EXPECT_EQ(array_int64_size(&a), 20u);
+  EXPECT_EQ(array_int64_get(&a, 10), static_cast<std::int64_t>(BIG_SIZE - 10) << 40);
+
+  array_int64_destroy(&a);
+}
+
+TEST(ArrayDefineTest, Int64Selection) {
+  struct array_int64 a;
+  array_int64_create(&a);
+  for (std::int64_t i = 0; i < BIG_SIZE; ++i) {
+    array_int64_push_back(&a, (i * 7919) % BIG_SIZE);
+  }
+
+  array_int64_nth_element(&a, BIG_SIZE / 2);
+  EXPECT_EQ(array_int64_get(&a, BIG_SIZE / 2), BIG_SIZE / 2);
+
+  array_int64_partial_sort(&a, 10);
+  for (std::int64_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(array_int64_get(&a, i), i);
+  }
+
+  array_int64_destroy(&a);
+}
+
+TEST(ArrayDefineTest, RecordHeap) {
+  struct array_record a;
+  array_record_create(&a);
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    array_record_heap_add(&a, record{ (i * 7919) % BIG_SIZE, static_cast<float>(i) });
+    EXPECT_TRUE(array_record_is_heap(&a));
+  }
+
+  for (int i = 0; i < BIG_SIZE; ++i) {
+    EXPECT_EQ(array_record_heap_top(&a).key, BIG_SIZE - i - 1);
+    array_record_heap_remove_top(&a);
+  }
+
+  EXPECT_TRUE(array_record_empty(&a));
+
+  array_record_destroy(&a);
+}
+
+TEST(ArrayDefineTest, RecordMatchesStructArray) {
+  // the int API and a record array sorted by key run the same kernels
+  struct array a;
+  struct array_record b;
+  array_create(&a);
+  array_record_create(&b);
+  for (int i = 0; i < 100 * BIG_SIZE; ++i) {
+    int key = (i * 7919) % (100 * BIG_SIZE);
+    array_push_back(&a, key);
+    array_record_push_back(&b, record{ key, 0.0f });
+  }
+
+  array_quick_sort(&a);
+  array_record_quick_sort(&b);
+
+  for (std::size_t i = 0; i < array_size(&a); ++i) {
+    ASSERT_EQ(array_get(&a, i), array_record_get(&b, i).key);
+  }
+  EXPECT_EQ(array_record_get(&b, 100 * BIG_SIZE).key, 0);
+
+  array_destroy(&a);
+  array_record_destroy(&b);
+}
+
+TEST(ArrayDefineTest, Growth) {
+  struct array_double a;
+  array_double_create(&a);
+  array_double_set_growth(&a, ARRAY_GROWTH_CHUNK, 100);
+
+  for (int i = 0; i < 250; ++i) {
+    array_double_push_back(&a, i);
+  }
+  EXPECT_EQ(a.capacity, 300u);
+
+  array_double_shrink_to_fit(&a);
+  EXPECT_EQ(a.capacity, 250u);
+
+  array_double_erase_range(&a, 0, 250);
+  array_double_shrink_to_fit(&a);
+  EXPECT_EQ(a.capacity, 0u);
+  EXPECT_EQ(a.data, nullptr);
+
+  array_double_destroy(&a);
+}
+
 int main(int argc, char *argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();